@@ -0,0 +1,53 @@
+#! /bin/bash
+set -e
+
+if [ "$#" -lt 7 ]; then
+    echo "Check a sharded certificate, written by approxmc --certshards 1, in parallel"
+    echo "usage: check_shards.sh eps del foo.xnf rand_file check_unsat_path jobs cert_file.0 cert_file.1 ..."
+    exit 1
+fi
+
+EPS=$1
+DEL=$2
+CNF=$3
+RAND=$4
+UNSAT=$5
+JOBS=$6
+shift 6
+
+CHECKER=${CERTCHECK:-./certcheck_cnf_xor}
+
+# Each shard is checked on its own, the output goes to shard.log and the
+# result to shard.verdict. The checker picks the random bits of the round.
+check_shard() {
+    SHARD=$1
+    ROUND=$(grep -m1 "^c round " $SHARD | cut -d' ' -f3)
+    HASHES=$(grep -m1 "^c hashes " $SHARD | cut -d' ' -f3)
+    echo "c checking shard $SHARD of round $ROUND" >&2
+    $CHECKER $EPS $DEL $CNF $RAND $SHARD $UNSAT round=$ROUND > $SHARD.log
+    CNT=$(grep "^s mc " $SHARD.log | cut -d' ' -f3)
+    if [ -z "$CNT" ]; then
+        echo "c shard $SHARD failed, see $SHARD.log" >&2
+        exit 1
+    fi
+    if [ "$HASHES" = "0" ]; then
+        echo "exact:$CNT" > $SHARD.verdict
+    else
+        echo "round:$ROUND:$CNT" > $SHARD.verdict
+    fi
+}
+export -f check_shard
+export EPS DEL CNF RAND UNSAT CHECKER
+
+for SHARD in "$@"; do
+    rm -f $SHARD.verdict
+done
+
+printf '%s\n' "$@" | xargs -P $JOBS -I{} bash -c 'check_shard {}'
+
+# The checker takes the median, it fails if a round is missing or duplicated
+VERDICTS=""
+for SHARD in "$@"; do
+    VERDICTS="$VERDICTS $(cat $SHARD.verdict)"
+done
+$CHECKER median $DEL $VERDICTS
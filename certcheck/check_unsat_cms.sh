@@ -4,11 +4,25 @@ set -e
 if [ "$#" -ne 1 ]; then
     echo "UNSAT check using CryptoMiniSAT"
     echo "usage: check_unsat foo.xnf"
+    echo "       check_unsat -        (read the formula from stdin)"
+    echo "Temporary files go to CHECK_UNSAT_TMPDIR, default TMPDIR or /tmp, e.g. /dev/shm"
+    echo "With CHECK_UNSAT_FIFO=1 the XLRUP proof is streamed to cake_xlrup through a FIFO"
 else
+
+TMP=${CHECK_UNSAT_TMPDIR:-${TMPDIR:-/tmp}}
+tempdir=$(mktemp -d -p $TMP)
+trap 'rm -rf $tempdir' EXIT
+
+# All tools read the formula, with "-" it is written once, to the temp dir
 CNF=$1
+if [ "$CNF" = "-" ]; then
+  CNF=$tempdir/formula.xnf
+  cat > $CNF
+fi
 
-tempxfrat=$(mktemp)
-tempxlrup=$(mktemp)
+# frat-xor reads the FRAT-XOR proof backwards, so it must be a file
+tempxfrat=$tempdir/proof.xfrat
+tempxlrup=$tempdir/proof.xlrup
 
 # Call CryptoMiniSAT
 set +e
@@ -23,15 +37,33 @@ then
 fi
 set -e
 
-# Call frat-xor elaborator
-echo "c calling frat-xor" >&2
+if [ "$CHECK_UNSAT_FIFO" = "1" ];
+then
+  mkfifo $tempxlrup
+
+  # Call frat-xor elaborator
+  echo "c calling frat-xor" >&2
 
-./cert_tools/frat-xor elab $tempxfrat $CNF $tempxlrup > /dev/null
+  # Translate FRAT-XOR to XLRUP proof, cake_xlrup reads it as it is written
+  ./cert_tools/frat-xor elab $tempxfrat $CNF $tempxlrup > /dev/null &
+  ELAB=$!
 
-# Call cake_xlrup verified proof checker
-echo "c calling cake_xlrup" >&2
+  # Call cake_xlrup verified proof checker
+  echo "c calling cake_xlrup" >&2
 
-OUTPUT=$(./cert_tools/cake_xlrup $CNF $tempxlrup)
+  OUTPUT=$(./cert_tools/cake_xlrup $CNF $tempxlrup)
+  wait $ELAB
+else
+  # Call frat-xor elaborator
+  echo "c calling frat-xor" >&2
+
+  ./cert_tools/frat-xor elab $tempxfrat $CNF $tempxlrup > /dev/null
+
+  # Call cake_xlrup verified proof checker
+  echo "c calling cake_xlrup" >&2
+
+  OUTPUT=$(./cert_tools/cake_xlrup $CNF $tempxlrup)
+fi
 
 if echo $OUTPUT | grep -q "s VERIFIED UNSAT";
 then
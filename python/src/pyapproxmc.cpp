@@ -33,7 +33,8 @@
 
 #include <limits>
 #include <vector>
-#include <set>
+#include <string>
+#include <gmpxx.h>
 
 #define MODULE_NAME "pyapproxmc"
 #define MODULE_DOC "ApproxMC approximate model counter."
@@ -44,29 +45,50 @@ typedef struct {
     ArjunNS::Arjun* arjun = NULL;
     std::vector<CMSat::Lit> tmp_cl_lits;
     bool count_called = false;
+    bool counting = false; //the GIL is released, no other call may touch it
 
     int verbosity;
     uint32_t seed;
     double epsilon;
     double delta;
+
+    // Arjun's simplification, as the command line's --withe, --eiter1, ...
+    int withe;
+    int eiter1;
+    int eiter2;
+    int evivif;
+    int esparsif;
+    int egetreds;
 } Counter;
 
 static const char counter_create_docstring[] = \
-"Counter(verbosity=0, seed=1, epsilon=0.8, delta=0.2)\n\
+"Counter(verbosity=0, seed=1, epsilon=0.8, delta=0.2, withe=1, eiter1=2, eiter2=0,\n\
+        evivif=1, esparsif=0, egetreds=0)\n\
 Create Counter object.\n\
 \n\
 :param verbosity: Verbosity level: 0: nothing printed; 15: very verbose.\n\
 :param seed: Random seed\n\
 :param epsilon: epsilon parameter as per PAC guarantees\n\
-:param delta: delta parameter as per PAC guarantees";
+:param delta: delta parameter as per PAC guarantees\n\
+:param withe: Eliminate variables and simplify the CNF after Arjun, as the\n\
+    command line does. The other parameters are those of its --eiter1,\n\
+    --eiter2, --evivif, --esparsif and --egetreds options.";
 
 /********** Internal Functions **********/
 
 /* Helper functions */
 
+static int check_not_counting(Counter* self)
+{
+    if (!self->counting) return 1;
+    PyErr_SetString(PyExc_RuntimeError, "ERROR: the Counter is counting on another thread");
+    return 0;
+}
+
 static void setup_counter(Counter *self, PyObject *args, PyObject *kwds)
 {
-    static char const* kwlist[] = {"verbosity", "seed", "epsilon", "delta", NULL};
+    static char const* kwlist[] = {"verbosity", "seed", "epsilon", "delta",
+        "withe", "eiter1", "eiter2", "evivif", "esparsif", "egetreds", NULL};
 
     // All parameters have the same default as the command line defaults
     // except for verbosity which is 0 by default.
@@ -74,9 +96,17 @@ static void setup_counter(Counter *self, PyObject *args, PyObject *kwds)
     self->seed = 1;
     self->epsilon = 0.8;
     self->delta = 0.2;
-
-    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|iIdd", const_cast<char**>(kwlist),
-        &self->verbosity, &self->seed, &self->epsilon, &self->delta))
+    self->withe = 1;
+    self->eiter1 = 2;
+    self->eiter2 = 0;
+    self->evivif = 1;
+    self->esparsif = 0;
+    self->egetreds = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|iIddiiiiii", const_cast<char**>(kwlist),
+        &self->verbosity, &self->seed, &self->epsilon, &self->delta,
+        &self->withe, &self->eiter1, &self->eiter2, &self->evivif, &self->esparsif,
+        &self->egetreds))
     {
         return;
     }
@@ -193,6 +223,7 @@ Add a clause to the solver.\n\
 
 static PyObject* add_clause(Counter *self, PyObject *args, PyObject *kwds)
 {
+    if (!check_not_counting(self)) return NULL;
     static char const* kwlist[] = {"clause", NULL};
     PyObject *clause;
     if (!PyArg_ParseTupleAndKeywords(args, kwds, "O", const_cast<char**>(kwlist), &clause)) {
@@ -293,6 +324,7 @@ Add iterable of clauses to the solver.\n\
 
 static PyObject* add_clauses(Counter *self, PyObject *args, PyObject *kwds)
 {
+    if (!check_not_counting(self)) return NULL;
     static char const* kwlist[] = {"clauses", NULL};
     PyObject *clauses;
     if (!PyArg_ParseTupleAndKeywords(args, kwds, "O", const_cast<char**>(kwlist), &clauses)) {
@@ -340,34 +372,21 @@ static PyObject* add_clauses(Counter *self, PyObject *args, PyObject *kwds)
 }
 
 
+// Same as get_cnf_from_arjun() of the command line
 static void get_cnf_from_arjun(Counter* self)
 {
     const uint32_t orig_num_vars = self->arjun->get_orig_num_vars();
     self->appmc->new_vars(orig_num_vars);
-    self->arjun->start_getting_small_clauses(
-        std::numeric_limits<uint32_t>::max(),
-        std::numeric_limits<uint32_t>::max(),
-        false);
+    self->arjun->start_getting_constraints();
     std::vector<CMSat::Lit> clause;
-
-    bool ret = true;
-    while (ret) {
-        ret = self->arjun->get_next_small_clause(clause);
-        if (!ret) {
-            break;
-        }
-
+    bool is_xor, rhs;
+    while (self->arjun->get_next_constraint(clause, is_xor, rhs)) {
+        assert(!is_xor); assert(rhs);
         bool ok = true;
-        for(auto l: clause) {
-            if (l.var() >= orig_num_vars) {
-                ok = false;
-                break;
-            }
-        }
-
+        for(auto l: clause) if (l.var() >= orig_num_vars) { ok = false; break; }
         if (ok) self->appmc->add_clause(clause);
     }
-    self->arjun->end_getting_small_clauses();
+    self->arjun->end_getting_constraints();
 }
 
 static void transfer_unit_clauses_from_arjun(Counter* self)
@@ -382,11 +401,64 @@ static void transfer_unit_clauses_from_arjun(Counter* self)
     }
 }
 
-static uint32_t set_up_sampling_set(Counter* self, const std::vector<uint32_t>& sampling_vars)
+// The pipeline of run_arjun() of the command line. Returns the sampling
+// set AppMC counts over and the multiplier of its count.
+static std::vector<uint32_t> run_arjun(Counter* self,
+    const std::vector<uint32_t>& sampling_vars, mpz_class& multiplier_weight)
 {
-    uint32_t orig_sampling_set_size;
-    orig_sampling_set_size = self->arjun->set_starting_sampling_set(sampling_vars);
-    return orig_sampling_set_size;
+    self->arjun->set_sampl_vars(sampling_vars);
+    std::vector<uint32_t> sampl_vars = self->arjun->run_backwards();
+    if (self->withe) {
+        ArjunNS::SimpConf sc;
+        sc.appmc = true;
+        sc.oracle_vivify = self->evivif;
+        sc.oracle_vivify_get_learnts = true;
+        sc.oracle_sparsify = self->esparsif;
+        sc.iter1 = self->eiter1;
+        sc.iter2 = self->eiter2;
+        auto ret = self->arjun->get_fully_simplified_renumbered_cnf(sc);
+        self->appmc->new_vars(ret.nvars);
+        for(const auto& cl: ret.cnf) self->appmc->add_clause(cl);
+        if (self->egetreds) {
+            for(const auto& cl: ret.red_cnf) self->appmc->add_red_clause(cl);
+        }
+        multiplier_weight = ret.multiplier_weight;
+        return ret.sampl_vars;
+    }
+
+    get_cnf_from_arjun(self);
+    transfer_unit_clauses_from_arjun(self);
+    mpz_class dummy(2);
+    mpz_pow_ui(dummy.get_mpz_t(), dummy.get_mpz_t(), self->arjun->get_empty_sampl_vars().size());
+    multiplier_weight = self->arjun->get_multiplier_weight()*dummy;
+    return sampl_vars;
+}
+
+// The count is returned as cell*2**hashes, the power of two of the
+// multiplier goes into the exponent, the rest into the cell
+static PyObject* count_to_tuple(const ApproxMC::SolCount& sol_count, mpz_class mult)
+{
+    mpz_class cell = sol_count.cellSolCount;
+    unsigned long exponent = sol_count.hashCount;
+    if (cell == 0 || mult == 0) {
+        cell = 0;
+        exponent = 0;
+    } else {
+        const unsigned long twos = mpz_scan1(mult.get_mpz_t(), 0);
+        mult >>= twos;
+        cell *= mult;
+        exponent += twos;
+    }
+
+    PyObject *result = PyTuple_New((Py_ssize_t) 2);
+    if (result == NULL) {
+        PyErr_SetString(PyExc_SystemError, "failed to create a tuple");
+        return NULL;
+    }
+    const std::string cell_str = cell.get_str();
+    PyTuple_SET_ITEM(result, 0, PyLong_FromString(cell_str.c_str(), NULL, 10));
+    PyTuple_SET_ITEM(result, 1, PyLong_FromUnsignedLong(exponent));
+    return result;
 }
 
 /* count function */
@@ -434,28 +506,16 @@ static PyObject* count(Counter *self, PyObject *args, PyObject *kwds)
         }
     }
 
-   //print_orig_sampling_vars(sampling_vars, self->arjun);
-   uint32_t orig_sampling_set_size = set_up_sampling_set(self, sampling_vars);
-   sampling_vars = self->arjun->get_indep_set();
-   std::vector<uint32_t> empty_occ_sampl_vars = self->arjun->get_empty_occ_sampl_vars();
-   //print_final_indep_set(sampling_vars , orig_sampling_set_size, empty_occ_sampl_vars);
-
-    std::set<uint32_t> sampl_vars_set;
-    sampl_vars_set.insert(sampling_vars.begin(), sampling_vars.end());
-    for(auto const& v: empty_occ_sampl_vars) {
-        assert(sampl_vars_set.find(v) != sampl_vars_set.end()); // this is guaranteed by arjun
-        sampl_vars_set.erase(v);
-    }
-    const size_t offset_count_by_2_pow = empty_occ_sampl_vars.size();
-    sampling_vars.clear();
-    sampling_vars.insert(sampling_vars.end(), sampl_vars_set.begin(), sampl_vars_set.end());
-
-    // Now do ApproxMC
-    get_cnf_from_arjun(self);
-    transfer_unit_clauses_from_arjun(self);
+    // Arjun and ApproxMC only touch this Counter's objects, other Python
+    // threads may run meanwhile
     ApproxMC::SolCount sol_count;
+    mpz_class multiplier_weight;
+    self->counting = true;
+    Py_BEGIN_ALLOW_THREADS
+
+    sampling_vars = run_arjun(self, sampling_vars, multiplier_weight);
     if (!sampling_vars.empty()) {
-        self->appmc->set_projection_set(sampling_vars);
+        self->appmc->set_sampl_vars(sampling_vars);
         sol_count = self->appmc->count();
     } else {
         bool ret = self->appmc->find_one_solution();
@@ -464,15 +524,85 @@ static PyObject* count(Counter *self, PyObject *args, PyObject *kwds)
         else sol_count.cellSolCount = 0;
     }
 
-    // Fill return value
-    PyObject *result = PyTuple_New((Py_ssize_t) 2);
-    if (result == NULL) {
-        PyErr_SetString(PyExc_SystemError, "failed to create a tuple");
+    Py_END_ALLOW_THREADS
+    self->counting = false;
+
+    return count_to_tuple(sol_count, multiplier_weight);
+}
+
+/* get_stats function */
+
+PyDoc_STRVAR(get_stats_doc,
+"get_stats()\n\
+Statistics of the count, for tuning epsilon and delta to a workload.\n\
+\n\
+:return: A dict with the number of SAT calls, reused models, solver\n\
+    conflicts, propagations and decisions, the hash count and cell size\n\
+    of every round, the time of every phase, the wall and CPU time and\n\
+    the peak memory in bytes. Empty if count() was not called, or was\n\
+    answered without counting."
+);
+
+static int dict_set(PyObject* dict, const char* key, PyObject* val)
+{
+    if (val == NULL) return -1;
+    const int ret = PyDict_SetItemString(dict, key, val);
+    Py_DECREF(val);
+    return ret;
+}
+
+template<class T>
+static PyObject* list_of_ints(const std::vector<T>& vals)
+{
+    PyObject* list = PyList_New((Py_ssize_t)vals.size());
+    if (list == NULL) return NULL;
+    for (size_t i = 0; i < vals.size(); i++) {
+        PyList_SET_ITEM(list, i, PyLong_FromUnsignedLongLong(vals[i]));
+    }
+    return list;
+}
+
+static PyObject* get_stats(Counter *self, PyObject *Py_UNUSED(ignored))
+{
+    if (!check_not_counting(self)) return NULL;
+    PyObject* dict = PyDict_New();
+    if (dict == NULL) return NULL;
+    const ApproxMC::CountStats& st = self->appmc->get_count_stats();
+    if (!self->count_called || st.round_hashes.empty()) return dict;
+
+    PyObject* phases = PyDict_New();
+    if (phases == NULL) {
+        Py_DECREF(dict);
         return NULL;
     }
-    PyTuple_SET_ITEM(result, 0, PyLong_FromLong((long)sol_count.cellSolCount));
-    PyTuple_SET_ITEM(result, 1, PyLong_FromLong((long)sol_count.hashCount+offset_count_by_2_pow));
-    return result;
+    for (const auto& p: st.phases) {
+        PyObject* phase = Py_BuildValue("{s:K,s:d,s:d}",
+            "calls", (unsigned long long)p.calls, "wall", p.wall, "cpu", p.cpu);
+        if (dict_set(phases, p.name.c_str(), phase) != 0) {
+            Py_DECREF(phases);
+            Py_DECREF(dict);
+            return NULL;
+        }
+    }
+
+    if (dict_set(dict, "version", PyLong_FromUnsignedLong(st.version)) != 0
+        || dict_set(dict, "sat_calls", PyLong_FromUnsignedLongLong(st.sat_calls)) != 0
+        || dict_set(dict, "repeated_models", PyLong_FromUnsignedLongLong(st.repeated_models)) != 0
+        || dict_set(dict, "conflicts", PyLong_FromUnsignedLongLong(st.conflicts)) != 0
+        || dict_set(dict, "propagations", PyLong_FromUnsignedLongLong(st.propagations)) != 0
+        || dict_set(dict, "decisions", PyLong_FromUnsignedLongLong(st.decisions)) != 0
+        || dict_set(dict, "round_hashes", list_of_ints(st.round_hashes)) != 0
+        || dict_set(dict, "round_cells", list_of_ints(st.round_cells)) != 0
+        || dict_set(dict, "phases", phases) != 0
+        || dict_set(dict, "wall", PyFloat_FromDouble(st.wall)) != 0
+        || dict_set(dict, "cpu", PyFloat_FromDouble(st.cpu)) != 0
+        || dict_set(dict, "peak_mem", PyLong_FromUnsignedLongLong(st.peak_mem)) != 0
+        || dict_set(dict, "seed", PyLong_FromUnsignedLong(st.seed)) != 0)
+    {
+        Py_DECREF(dict);
+        return NULL;
+    }
+    return dict;
 }
 
 /********** Python Bindings **********/
@@ -480,6 +610,7 @@ static PyMethodDef Counter_methods[] = {
     {"count",     (PyCFunction) count,       METH_VARARGS | METH_KEYWORDS, count_doc},
     {"add_clause",(PyCFunction) add_clause,  METH_VARARGS | METH_KEYWORDS, add_clause_doc},
     {"add_clauses", (PyCFunction) add_clauses,  METH_VARARGS | METH_KEYWORDS, add_clauses_doc},
+    {"get_stats", (PyCFunction) get_stats,   METH_NOARGS, get_stats_doc},
     {NULL, NULL}  // Sentinel
 };
 
@@ -492,6 +623,7 @@ static void Counter_dealloc(Counter* self)
 
 static int Counter_init(Counter *self, PyObject *args, PyObject *kwds)
 {
+    if (!check_not_counting(self)) return -1;
     if (self->appmc != NULL) delete self->appmc;
     if (self->arjun != NULL) delete self->arjun;
 
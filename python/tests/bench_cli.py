@@ -0,0 +1,70 @@
+#!/usr/bin/env python3
+# Counts the same CNF files with the approxmc binary and with pyapproxmc, with
+# the same seed and options, and prints the time of each. Both run Arjun with
+# the same simplification, so the times should be close and the counts equal.
+#
+# usage: bench_cli.py path/to/approxmc file1.cnf [file2.cnf ...]
+
+import subprocess
+import sys
+import time
+
+from pyapproxmc import Counter
+
+
+def read_cnf(fname):
+    clauses = []
+    sampl_vars = None
+    with open(fname) as f:
+        for line in f:
+            tokens = line.split()
+            if not tokens or tokens[0] == "p":
+                continue
+            if tokens[0] == "c":
+                if len(tokens) > 2 and tokens[1] == "ind":
+                    sampl_vars = (sampl_vars or []) + [int(t) for t in tokens[2:] if t != "0"]
+                continue
+            clauses.append([int(t) for t in tokens if t != "0"])
+    return clauses, sampl_vars
+
+
+def count_cli(binary, fname, seed):
+    start = time.perf_counter()
+    out = subprocess.run([binary, "--seed", str(seed), fname],
+                         capture_output=True, text=True).stdout
+    elapsed = time.perf_counter() - start
+    count = None
+    for line in out.splitlines():
+        if line.startswith("s mc "):
+            count = int(line.split()[2])
+    return count, elapsed
+
+
+def count_python(fname, seed):
+    start = time.perf_counter()
+    clauses, sampl_vars = read_cnf(fname)
+    counter = Counter(seed=seed)
+    counter.add_clauses(clauses)
+    if sampl_vars is None:
+        cell, exponent = counter.count()
+    else:
+        cell, exponent = counter.count(sampl_vars)
+    return cell * 2**exponent, time.perf_counter() - start
+
+
+def main():
+    if len(sys.argv) < 3:
+        print("usage: bench_cli.py path/to/approxmc file1.cnf [file2.cnf ...]")
+        sys.exit(1)
+    binary = sys.argv[1]
+    seed = 1
+    print(f"{'file':40} {'cli s':>8} {'python s':>9}  counts")
+    for fname in sys.argv[2:]:
+        cli_count, cli_time = count_cli(binary, fname, seed)
+        py_count, py_time = count_python(fname, seed)
+        same = "same" if cli_count == py_count else f"DIFFER {cli_count} {py_count}"
+        print(f"{fname:40} {cli_time:8.2f} {py_time:9.2f}  {same}")
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,55 @@
+#!/usr/bin/env python3
+# Counts independent random formulas one after the other and then on a pool
+# of threads. pyapproxmc releases the GIL while counting, so the threads
+# should scale close to linearly up to the number of cores.
+#
+# usage: bench_threads.py [formulas] [threads] [vars]
+
+import os
+import random
+import sys
+import time
+from concurrent.futures import ThreadPoolExecutor
+
+from pyapproxmc import Counter
+
+
+def random_formula(seed, nvars):
+    rnd = random.Random(seed)
+    clauses = []
+    for _ in range(int(nvars*3.5)):
+        vs = rnd.sample(range(1, nvars+1), 3)
+        clauses.append([v if rnd.random() < 0.5 else -v for v in vs])
+    return clauses
+
+
+def count(clauses):
+    counter = Counter(seed=1, epsilon=0.8, delta=0.2)
+    counter.add_clauses(clauses)
+    return counter.count()
+
+
+def main():
+    formulas = int(sys.argv[1]) if len(sys.argv) > 1 else 16
+    threads = int(sys.argv[2]) if len(sys.argv) > 2 else os.cpu_count()
+    nvars = int(sys.argv[3]) if len(sys.argv) > 3 else 60
+    cnfs = [random_formula(i, nvars) for i in range(formulas)]
+
+    start = time.perf_counter()
+    serial = [count(cnf) for cnf in cnfs]
+    serial_time = time.perf_counter() - start
+
+    start = time.perf_counter()
+    with ThreadPoolExecutor(max_workers=threads) as pool:
+        parallel = list(pool.map(count, cnfs))
+    parallel_time = time.perf_counter() - start
+
+    assert serial == parallel, "counts differ between serial and threaded runs"
+    print(f"formulas: {formulas} vars: {nvars} threads: {threads}")
+    print(f"serial:   {serial_time:8.2f} s")
+    print(f"threaded: {parallel_time:8.2f} s")
+    print(f"speedup:  {serial_time/parallel_time:8.2f}x")
+
+
+if __name__ == '__main__':
+    main()
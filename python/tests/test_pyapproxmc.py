@@ -4,6 +4,7 @@ from array import array
 from pathlib import Path
 
 import pytest
+from concurrent.futures import ThreadPoolExecutor
 
 from pyapproxmc import Counter
 
@@ -20,7 +21,8 @@ def test_minimal():
 def test_sampling_set():
     counter = Counter(seed=2157, epsilon=0.8, delta=0.2)
     counter.add_clause(range(1,100))
-    assert counter.count(list(range(1,50))) == (64, 43)
+    significand, exponent = counter.count(list(range(1,50)))
+    assert significand * 2**exponent == 64 * 2**43
 
 
 def test_real_example():
@@ -36,7 +38,8 @@ def test_real_example():
             literals = [int(i) for i in line.split()[:-1]]
             counter.add_clause(literals)
 
-    assert counter.count(list(range(1,21))) == (64,14)
+    significand, exponent = counter.count(list(range(1,21)))
+    assert significand * 2**exponent == 64 * 2**14
 
 
 def test_add_clauses_minimal():
@@ -69,6 +72,36 @@ def test_add_clauses_real_example():
     assert significand * 2**exponent == 64 * 2**14
 
 
+def test_stats():
+    counter = Counter(seed=2157, epsilon=0.8, delta=0.2, withe=0)
+    assert counter.get_stats() == {}
+    counter.add_clause(range(1,100))
+    counter.count(list(range(1,50)))
+    stats = counter.get_stats()
+    assert stats["sat_calls"] > 0
+    assert len(stats["round_hashes"]) == len(stats["round_cells"])
+    assert "bounded_sol_count" in stats["phases"]
+
+
+def test_without_e():
+    counter = Counter(seed=2157, epsilon=0.8, delta=0.2, withe=0)
+    counter.add_clause(range(1,100))
+    significand, exponent = counter.count(list(range(1,50)))
+    assert significand * 2**exponent == 64 * 2**43
+
+
+def test_threads():
+    def count(n):
+        counter = Counter(seed=2157, epsilon=0.8, delta=0.2)
+        counter.add_clause(range(1,100))
+        significand, exponent = counter.count(list(range(1,n)))
+        return significand * 2**exponent
+
+    with ThreadPoolExecutor(max_workers=4) as pool:
+        counts = list(pool.map(count, [50]*4 + [21]*4))
+    assert counts == [64 * 2**43]*4 + [count(21)]*4
+
+
 if __name__ == '__main__':
     ret = pytest.main([__file__, '-v'] + sys.argv[1:])
     raise SystemExit(ret)
@@ -63,6 +63,9 @@ def gen_modules(version):
                    "src/approxmc.cpp",
                    "src/appmc_constants.cpp",
                    "src/counter.cpp",
+                   "src/checkpoint.cpp",
+                   "src/eventlog.cpp",
+                   "src/trace.cpp",
                    "python/cryptominisat/python/src/GitSHA1.cpp",
                    "python/cryptominisat/src/bva.cpp",
                    "python/cryptominisat/src/cardfinder.cpp",
@@ -39,6 +39,12 @@ using std::endl;
 using std::vector;
 using namespace AppMCInt;
 
+const Constants& Constants::get()
+{
+    static const Constants constants;
+    return constants;
+}
+
 Constants::Constants() {
     //So if you have 50 hashes, then between 1-6, use 0.5 prob, between 7-8 use 0.49, between 9-10 0.48
     sparseprobvalues = {{
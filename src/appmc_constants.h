@@ -53,6 +53,7 @@ class Constants
 {
 public:
     Constants();
+    static const Constants& get(); //parsed once, shared by every Counter
     vector<double> probval;
     vector<VarMap> index_var_maps;
     vector<double> iterationConfidences;
@@ -31,6 +31,8 @@
 #include "appmc_constants.h"
 #include "config.h"
 #include <iostream>
+#include <algorithm>
+#include <limits>
 
 using std::cout;
 using std::endl;
@@ -48,19 +50,79 @@ namespace ApproxMC {
         AppMCPrivateData(): counter(conf) {}
         Config conf;
         Counter counter;
+        vector<uint32_t> solver_sampl_vars; //if set, the solver keeps these instead
     };
 }
 
 using namespace ApproxMC;
 
-DLL_PUBLIC AppMC::AppMC()
+static void new_solver(AppMCPrivateData* data)
 {
-    data = new AppMCPrivateData;
     data->counter.solver = new SATSolver();
     data->counter.solver->set_up_for_scalmc();
     data->counter.solver->set_allow_otf_gauss();
 }
 
+DLL_PUBLIC AppMC::AppMC()
+{
+    data = new AppMCPrivateData;
+    new_solver(data);
+}
+
+// CryptoMiniSat cannot drop its clauses, so only the solver is made anew
+DLL_PUBLIC void AppMC::reset()
+{
+    delete data->counter.solver;
+    data->counter.solver = nullptr;
+    data->conf = Config();
+    data->solver_sampl_vars.clear();
+    data->counter.reset();
+    new_solver(data);
+}
+
+DLL_PUBLIC AppMCPool::AppMCPool(size_t _max_idle) :
+    max_idle(_max_idle)
+{}
+
+DLL_PUBLIC AppMCPool::~AppMCPool()
+{
+    for (AppMC* appmc: instances) delete appmc;
+}
+
+DLL_PUBLIC AppMCPool::Handle AppMCPool::acquire()
+{
+    AppMC* appmc = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!instances.empty()) {
+            appmc = instances.back();
+            instances.pop_back();
+        }
+    }
+    if (!appmc) appmc = new AppMC;
+    return Handle(appmc, Release{this});
+}
+
+DLL_PUBLIC size_t AppMCPool::idle() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return instances.size();
+}
+
+// Reset on the thread that gives it back, acquire() stays cheap
+DLL_PUBLIC void AppMCPool::Release::operator()(AppMC* appmc) const
+{
+    appmc->reset();
+    {
+        std::lock_guard<std::mutex> lock(pool->mutex);
+        if (pool->instances.size() < pool->max_idle) {
+            pool->instances.push_back(appmc);
+            return;
+        }
+    }
+    delete appmc;
+}
+
 DLL_PUBLIC AppMC::~AppMC()
 {
     delete data->counter.solver;
@@ -96,7 +158,11 @@ void setup_sampling_vars(AppMCPrivateData* data)
         }
     }
 
-    data->counter.solver->set_sampl_vars(data->conf.sampl_vars);
+    if (!data->solver_sampl_vars.empty()) {
+        data->counter.solver->set_sampl_vars(data->solver_sampl_vars);
+    } else {
+        data->counter.solver->set_sampl_vars(data->conf.sampl_vars);
+    }
 }
 
 DLL_PUBLIC string AppMC::get_version_info()
@@ -109,6 +175,11 @@ DLL_PUBLIC void AppMC::set_up_log(string log_file_name)
     data->conf.logfilename = log_file_name;
 }
 
+DLL_PUBLIC void AppMC::set_up_log_fd(int fd)
+{
+    data->conf.log_fd = fd;
+}
+
 DLL_PUBLIC void AppMC::set_up_randbits(string rand_file_name)
 {
     data->conf.randfilename = rand_file_name;
@@ -119,6 +190,11 @@ DLL_PUBLIC void AppMC::set_up_cert(string cert_file_name)
     data->conf.certfilename = cert_file_name;
 }
 
+DLL_PUBLIC void AppMC::set_cert_shards(int cert_shards)
+{
+    data->conf.cert_shards = cert_shards;
+}
+
 DLL_PUBLIC void AppMC::set_verbosity(uint32_t verb)
 {
     data->conf.verb = verb;
@@ -224,6 +300,11 @@ DLL_PUBLIC bool AppMC::find_one_solution()
 }
 
 DLL_PUBLIC ApproxMC::SolCount AppMC::count()
+{
+    return count(vector<Lit>());
+}
+
+DLL_PUBLIC ApproxMC::SolCount AppMC::count(const vector<Lit>& assumptions)
 {
     if (data->conf.verb > 2) {
         cout << "c [appmc] using seed: " << data->conf.seed << endl;
@@ -239,11 +320,139 @@ DLL_PUBLIC ApproxMC::SolCount AppMC::count()
         exit(-1);
     }
 
+    if (data->conf.incremental
+        && (!data->conf.certfilename.empty() || !data->conf.checkpoint_fname.empty()))
+    {
+        cout << "[appmc] ERROR: certificates and checkpoints are not supported"
+            " for incremental counts" << endl;
+        exit(-1);
+    }
+    // The certificate starts with the cell at 0 hashes, which a count that
+    // starts at a higher hash count does not visit
+    if (data->conf.start_iter > 0 && !data->conf.certfilename.empty()) {
+        cout << "[appmc] ERROR: certificates are not supported with a start hash count above 0" << endl;
+        exit(-1);
+    }
+    if (!assumptions.empty() && !data->conf.certfilename.empty()) {
+        cout << "[appmc] ERROR: certificates are not supported for counts under assumptions" << endl;
+        exit(-1);
+    }
+    for (const Lit l: assumptions) {
+        if (l.var() >= data->counter.solver->nVars()) {
+            cout << "[appmc] ERROR: assumption " << l << " is over a variable that does not exist" << endl;
+            exit(-1);
+        }
+    }
+
     setup_sampling_vars(data);
-    SolCount sol_count = data->counter.solve();
+    SolCount sol_count = data->counter.solve(assumptions);
     return sol_count;
 }
 
+// The solver keeps the variables of every set, what it eliminates while
+// counting one set is then not needed by the others
+DLL_PUBLIC vector<SolCount> AppMC::count_sampl_sets(
+    const vector<vector<uint32_t>>& sets, vector<CountStats>* stats)
+{
+    if (!data->conf.certfilename.empty() || !data->conf.checkpoint_fname.empty()
+        || !data->conf.randfilename.empty()
+    ) {
+        cout << "[appmc] ERROR: certificates, random bit files and checkpoints are"
+            " not supported when counting many sampling sets" << endl;
+        exit(-1);
+    }
+    vector<uint32_t> all_vars;
+    for (const auto& vars: sets) {
+        if (vars.empty()) {
+            cout << "[appmc] ERROR: sampling sets to count must not be empty" << endl;
+            exit(-1);
+        }
+        all_vars.insert(all_vars.end(), vars.begin(), vars.end());
+    }
+    std::sort(all_vars.begin(), all_vars.end());
+    all_vars.erase(std::unique(all_vars.begin(), all_vars.end()), all_vars.end());
+
+    const vector<uint32_t> orig_sampl_vars = data->conf.sampl_vars;
+    const bool orig_sampl_vars_set = data->conf.sampl_vars_set;
+    const uint32_t orig_seed = data->conf.seed;
+    data->solver_sampl_vars = all_vars;
+    vector<SolCount> counts;
+    if (stats) stats->clear();
+    for (uint32_t i = 0; i < sets.size(); i++) {
+        // Every count seeds its hashes anew, so each set gets its own seed.
+        // The first one keeps the seed, as with count().
+        data->conf.seed = orig_seed ^ (i * 0x9e3779b9U);
+        set_sampl_vars(sets[i]);
+        counts.push_back(count());
+        if (stats) stats->push_back(data->counter.stats);
+        if (data->counter.stopped_early) break;
+    }
+    data->solver_sampl_vars.clear();
+    data->conf.sampl_vars = orig_sampl_vars;
+    data->conf.sampl_vars_set = orig_sampl_vars_set;
+    data->conf.seed = orig_seed;
+    return counts;
+}
+
+DLL_PUBLIC CountHandle AppMC::count_async()
+{
+    CountHandle handle;
+    handle.appmc = this;
+    handle.result = std::async(std::launch::async, [this]() { return count(); });
+    return handle;
+}
+
+DLL_PUBLIC void CountHandle::cancel()
+{
+    if (appmc) appmc->interrupt_asap();
+}
+
+DLL_PUBLIC void AppMC::set_progress_callback(ProgressCallback callback)
+{
+    data->counter.progress = callback;
+}
+
+DLL_PUBLIC void AppMC::set_checkpoint(const std::string& fname, bool resume)
+{
+    data->conf.checkpoint_fname = fname;
+    data->conf.resume = resume;
+}
+
+DLL_PUBLIC void AppMC::set_incremental(bool incremental)
+{
+    data->conf.incremental = incremental;
+}
+
+DLL_PUBLIC void AppMC::set_max_time(double max_time)
+{
+    data->conf.max_time = max_time;
+}
+
+DLL_PUBLIC void AppMC::interrupt_asap()
+{
+    data->counter.interrupt_asap();
+}
+
+DLL_PUBLIC bool AppMC::get_stopped_early() const
+{
+    return data->counter.stopped_early;
+}
+
+DLL_PUBLIC uint32_t AppMC::get_rounds_done() const
+{
+    return data->counter.rounds_done;
+}
+
+DLL_PUBLIC double AppMC::get_effective_delta() const
+{
+    return data->counter.effective_delta;
+}
+
+DLL_PUBLIC const CountStats& AppMC::get_count_stats() const
+{
+    return data->counter.stats;
+}
+
 DLL_PUBLIC void AppMC::set_sampl_vars(const vector<uint32_t>& vars)
 {
     data->conf.sampl_vars_set = true;
@@ -283,19 +492,64 @@ DLL_PUBLIC bool AppMC::add_red_clause(const vector<CMSat::Lit>& lits)
 
 DLL_PUBLIC bool AppMC::add_clause(const vector<CMSat::Lit>& lits)
 {
+    data->counter.digest_input(0, lits);
     return data->counter.solver_add_clause(lits);
 }
 
 DLL_PUBLIC bool AppMC::add_xor_clause(const vector<Lit>& lits, bool rhs)
 {
+    data->counter.digest_input(1+rhs, lits);
     return data->counter.solver_add_xor_clause(lits, rhs);
 }
 
 DLL_PUBLIC bool AppMC::add_xor_clause(const vector<uint32_t>& vars, bool rhs)
 {
+    vector<Lit> lits;
+    for (const uint32_t v: vars) lits.push_back(Lit(v, false));
+    data->counter.digest_input(1+rhs, lits);
     return data->counter.solver_add_xor_clause(vars, rhs);
 }
 
+DLL_PUBLIC bool AppMC::add_clauses(const Lit* lits, size_t n_lits,
+    const uint32_t* offsets, size_t n_clauses)
+{
+    // The offsets could not reach the literals past that, add those in
+    // another call, or with the DIMACS variant
+    if (n_lits > std::numeric_limits<uint32_t>::max()) {
+        cout << "[appmc] ERROR: at most 2^32-1 literals can be added in one call" << endl;
+        exit(-1);
+    }
+    for (size_t i = 0; i < n_clauses; i++) {
+        const size_t end = i+1 < n_clauses ? offsets[i+1] : n_lits;
+        if (offsets[i] > end || end > n_lits) {
+            cout << "[appmc] ERROR: clause offsets must grow and stay within the literals" << endl;
+            exit(-1);
+        }
+        if (!data->counter.solver_add_clause(lits+offsets[i], lits+end)) return false;
+    }
+    return true;
+}
+
+DLL_PUBLIC bool AppMC::add_clauses(const int32_t* dimacs, size_t n)
+{
+    size_t start = 0;
+    for (size_t i = 0; i < n; i++) {
+        // Cannot be negated, it would be undefined below
+        if (dimacs[i] == std::numeric_limits<int32_t>::min()) {
+            cout << "[appmc] ERROR: literal " << dimacs[i] << " is out of range" << endl;
+            exit(-1);
+        }
+        if (dimacs[i] != 0) continue;
+        if (!data->counter.solver_add_dimacs_clause(dimacs+start, dimacs+i)) return false;
+        start = i+1;
+    }
+    if (start != n) {
+        cout << "[appmc] ERROR: the last clause does not end with a 0" << endl;
+        exit(-1);
+    }
+    return true;
+}
+
 DLL_PUBLIC CMSat::SATSolver* AppMC::get_solver()
 {
     return data->counter.solver;
@@ -33,6 +33,10 @@
 #include <cstdint>
 #include <string>
 #include <vector>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
 #ifdef CMS_LOCAL_BUILD
 #include "cryptominisat.h"
 #else
@@ -57,6 +61,63 @@ struct SolCount
     uint32_t cellSolCount = 0;
 };
 
+// What a count did, for tuning. Fields are only ever added at the end, and
+// the version goes up when they are.
+#define APPMC_COUNT_STATS_VERSION 2
+
+struct CountPhase
+{
+    std::string name;
+    uint64_t calls = 0;
+    double wall = 0;
+    double cpu = 0;
+};
+
+#ifdef _WIN32
+struct __declspec(dllexport) CountStats
+#else
+struct CountStats
+#endif
+{
+    uint32_t version = APPMC_COUNT_STATS_VERSION;
+    uint64_t sat_calls = 0;
+    uint64_t repeated_models = 0; //models of earlier cells that were reused
+    uint64_t conflicts = 0;
+    uint64_t propagations = 0;
+    uint64_t decisions = 0;
+    std::vector<uint32_t> round_hashes; //of the rounds the count is the median of
+    std::vector<uint64_t> round_cells;
+    std::vector<CountPhase> phases;
+    double wall = 0;
+    double cpu = 0;
+    uint64_t peak_mem = 0; //bytes, of the whole process
+    uint32_t seed = 0; //the hashes were drawn with, since version 2
+};
+
+// Given to the progress callback after every round
+struct CountProgress
+{
+    uint32_t rounds_done = 0;
+    uint32_t rounds = 0; //that the count will do if it is not stopped
+    SolCount estimate; //median of the rounds done so far
+    double elapsed = 0; //wall-clock seconds since count() started
+};
+typedef std::function<void(const CountProgress&)> ProgressCallback;
+
+class AppMC;
+
+// A count running on its own thread, see count_async()
+#ifdef _WIN32
+struct __declspec(dllexport) CountHandle
+#else
+struct CountHandle
+#endif
+{
+    std::future<SolCount> result;
+    void cancel(); //the result is then that of a stopped count
+    AppMC* appmc = nullptr;
+};
+
 struct AppMCPrivateData;
 #ifdef _WIN32
 class __declspec(dllexport) AppMC
@@ -67,9 +128,62 @@ class AppMC
 public:
     AppMC();
     ~AppMC();
+    // Drops the formula, options and state, as if newly constructed. The
+    // SAT solver is deleted and created again, only the AppMC itself and its
+    // tables are kept.
+    void reset();
     ApproxMC::SolCount count();
+    // Counts the solutions that agree with the assumptions. The solver, with
+    // what it learnt, is kept between calls, so many assumptions can be
+    // counted over the same formula without loading it again. Not with
+    // certificates, add the assumptions as unit clauses for those.
+    ApproxMC::SolCount count(const std::vector<CMSat::Lit>& assumptions);
+    // Counts the formula projected on each of the sets, one after the other
+    // on the same solver, so that parsing, simplification and what was learnt
+    // are shared. Set i is counted with the seed XOR i*0x9e3779b9, so the
+    // first one gets the seed and the others their own hashes; the stats hold
+    // the seed used. Stops after a count that was stopped early, the result
+    // is then shorter than the sets. Not with certificates, random bit files
+    // or checkpoints.
+    std::vector<ApproxMC::SolCount> count_sampl_sets(
+        const std::vector<std::vector<uint32_t>>& sets,
+        std::vector<CountStats>* stats = nullptr);
     bool find_one_solution();
 
+    // Runs count() on a new thread. The AppMC must not be touched until the
+    // result is there, destroying the handle waits for it.
+    CountHandle count_async();
+
+    // Called on the counting thread after every round
+    void set_progress_callback(ProgressCallback callback);
+
+    // Stopping early. count() then returns the median of the rounds done so
+    // far, with a lower confidence. It is not valid if no round was done.
+    void set_max_time(double max_time); //wall-clock seconds, 0 = no limit
+    void interrupt_asap(); //also stops the SAT call, safe in a signal handler
+    bool get_stopped_early() const;
+    uint32_t get_rounds_done() const;
+    double get_effective_delta() const;
+
+    // Of the last count
+    const CountStats& get_count_stats() const;
+
+    // Writes the state of the count to this file every other round, and,
+    // with resume, goes on from the state in it if it is there. The formula,
+    // sampling set and options must be the same. The file is removed when
+    // the count is done.
+    void set_checkpoint(const std::string& fname, bool resume);
+
+    // A count after clauses were added starts every round from the hash
+    // count of that round in the last count, with the same hashes, and
+    // reuses the models of the round that still satisfy the new clauses,
+    // galloping down from there. As the hashes are reused, the new estimate
+    // is not independent of the last one: their errors go together, so they
+    // must not be combined as if they were two counts. Only if the sampling
+    // set, assumptions and options are the same. Not with certificates or
+    // checkpoints.
+    void set_incremental(bool incremental);
+
     // Sampling set
     void set_sampl_vars(const std::vector<uint32_t>& vars);
     void set_opt_sampl_vars(const std::vector<uint32_t>& vars);
@@ -88,6 +202,13 @@ public:
     bool add_red_clause(const std::vector<CMSat::Lit>& lits);
     bool add_xor_clause(const std::vector<CMSat::Lit>& lits, bool rhs);
     bool add_xor_clause(const std::vector<uint32_t>& vars, bool rhs);
+    // Many clauses in one call, without a vector per clause. Clause i is
+    // lits[offsets[i]] up to the next offset, the last one up to n_lits.
+    // n_lits must fit the offsets, i.e. be below 2^32.
+    bool add_clauses(const CMSat::Lit* lits, size_t n_lits,
+        const uint32_t* offsets, size_t n_clauses);
+    // DIMACS literals, every clause ends with a 0. -2^31 is not a literal.
+    bool add_clauses(const int32_t* dimacs, size_t n);
 
     // Information about approxmc
     std::string get_version_info();
@@ -95,8 +216,10 @@ public:
 
     //Main options
     void set_up_log(std::string log_file_name);
+    void set_up_log_fd(int fd);
     void set_up_randbits(std::string log_file_name);
     void set_up_cert(std::string cert_file_name);
+    void set_cert_shards(int cert_shards);
     void set_verbosity(uint32_t verb);
     void set_seed(uint32_t seed);
     void set_epsilon(double epsilon);
@@ -132,6 +255,36 @@ private:
     AppMCPrivateData* data;
 };
 
+// Hands out AppMC instances that are reset when given back, so that they
+// are ready for the next formula. The pool must outlive its handles.
+// Each reset still creates a new SAT solver, as CryptoMiniSat cannot drop
+// its clauses: the pool only keeps the AppMC and its tables.
+#ifdef _WIN32
+class __declspec(dllexport) AppMCPool
+#else
+class AppMCPool
+#endif
+{
+public:
+    explicit AppMCPool(size_t max_idle = 16);
+    ~AppMCPool();
+    AppMCPool(const AppMCPool&) = delete;
+    AppMCPool& operator=(const AppMCPool&) = delete;
+
+    struct Release {
+        AppMCPool* pool;
+        void operator()(AppMC* appmc) const;
+    };
+    typedef std::unique_ptr<AppMC, Release> Handle;
+    Handle acquire(); //thread-safe
+    size_t idle() const;
+
+private:
+    const size_t max_idle;
+    mutable std::mutex mutex;
+    std::vector<AppMC*> instances;
+};
+
 }
 
 #endif
@@ -0,0 +1,199 @@
+/*
+ ApproxMC
+
+ Copyright (c) 2019-2020, Mate Soos and Kuldeep S. Meel. All rights reserved
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#include "batch.h"
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <map>
+#include <chrono>
+#include <new>
+#include <cerrno>
+#include <cstring>
+#include <cmath>
+
+#if !defined(_WIN32) && !defined(__EMSCRIPTEN__)
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#define APPMC_BATCH
+#endif
+
+using std::string;
+using std::vector;
+using std::cout;
+using std::endl;
+
+namespace AppMCInt {
+
+vector<string> read_batch_manifest(const string& fname)
+{
+    std::ifstream in(fname);
+    if (!in) {
+        std::cerr << "ERROR! Could not open batch manifest '" << fname
+        << "' for reading: " << strerror(errno) << endl;
+        exit(-1);
+    }
+    vector<string> files;
+    string line;
+    while (std::getline(in, line)) {
+        const size_t from = line.find_first_not_of(" \t\r");
+        if (from == string::npos || line[from] == '#') continue;
+        const size_t to = line.find_last_not_of(" \t\r");
+        files.push_back(line.substr(from, to-from+1));
+    }
+    return files;
+}
+
+#ifndef APPMC_BATCH
+uint32_t run_batch(
+    const vector<string>&, const BatchConf&,
+    const std::function<string(size_t, const string&)>&)
+{
+    cout << "ERROR: batch mode is not supported on this platform" << endl;
+    exit(-1);
+}
+#else
+
+// Exit code of an instance that ran out of memory
+static const int memout_exit = 33;
+
+static void write_all(int fd, const string& s)
+{
+    size_t at = 0;
+    while (at < s.size()) {
+        const ssize_t n = write(fd, s.data()+at, s.size()-at);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return;
+        at += n;
+    }
+}
+
+static string read_all(int fd)
+{
+    string s;
+    char buf[4096];
+    while (true) {
+        const ssize_t n = read(fd, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return s;
+        s.append(buf, n);
+    }
+}
+
+struct BatchRunning {
+    size_t idx;
+    int fd;
+    std::chrono::steady_clock::time_point start;
+};
+
+uint32_t run_batch(
+    const vector<string>& files,
+    const BatchConf& conf,
+    const std::function<string(size_t, const string&)>& count)
+{
+    cout << "c [batch] instances: " << files.size() << " jobs: " << conf.jobs
+    << " time limit: " << conf.max_time << " s mem limit: " << conf.max_mem << " MB" << endl;
+    cout << "c [batch] columns: index status count wall_s cpu_s maxrss_MB file" << endl;
+
+    std::map<pid_t, BatchRunning> running;
+    size_t next = 0;
+    uint32_t failed = 0;
+    while (next < files.size() || !running.empty()) {
+        while (running.size() < std::max<uint32_t>(conf.jobs, 1) && next < files.size()) {
+            const size_t idx = next++;
+            int fds[2];
+            if (pipe(fds) != 0) {
+                cout << "ERROR: could not create pipe: " << strerror(errno) << endl;
+                exit(-1);
+            }
+            // Buffered output would be written again by the child
+            cout.flush();
+            std::cerr.flush();
+            const pid_t pid = fork();
+            if (pid < 0) {
+                cout << "ERROR: could not fork: " << strerror(errno) << endl;
+                exit(-1);
+            }
+            if (pid == 0) {
+                close(fds[0]);
+                for (const auto& r: running) close(r.second.fd);
+                const int devnull = open("/dev/null", O_WRONLY);
+                if (devnull >= 0) dup2(devnull, STDOUT_FILENO);
+                if (conf.max_mem) {
+                    struct rlimit rl;
+                    rl.rlim_cur = rl.rlim_max = conf.max_mem << 20;
+                    setrlimit(RLIMIT_AS, &rl);
+                }
+                std::set_new_handler([]() {_exit(memout_exit);});
+                if (conf.max_time) alarm(conf.max_time);
+
+                const string res = count(idx, files[idx]);
+                cout.flush();
+                write_all(fds[1], res);
+                _exit(0);
+            }
+            close(fds[1]);
+            running[pid] = BatchRunning{idx, fds[0], std::chrono::steady_clock::now()};
+        }
+
+        int status;
+        struct rusage ru;
+        const pid_t pid = wait4(-1, &status, 0, &ru);
+        if (pid < 0) {
+            if (errno == EINTR) continue;
+            cout << "ERROR: waiting for instances failed: " << strerror(errno) << endl;
+            exit(-1);
+        }
+        const auto it = running.find(pid);
+        if (it == running.end()) continue;
+        const BatchRunning r = it->second;
+        running.erase(it);
+        const string res = read_all(r.fd);
+        close(r.fd);
+
+        string st = "error";
+        if (WIFEXITED(status) && WEXITSTATUS(status) == 0 && !res.empty()) st = "ok";
+        else if (WIFEXITED(status) && WEXITSTATUS(status) == memout_exit) st = "memout";
+        else if (WIFSIGNALED(status) && WTERMSIG(status) == SIGALRM) st = "timeout";
+        if (st != "ok") failed++;
+
+        const double wall = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - r.start).count();
+        const double cpu = ru.ru_utime.tv_sec + ru.ru_utime.tv_usec/1e6
+            + ru.ru_stime.tv_sec + ru.ru_stime.tv_usec/1e6;
+        cout << "s batch " << r.idx << " " << st << " " << (st == "ok" ? res : "-")
+        << std::fixed << std::setprecision(2)
+        << " " << wall << " " << cpu << " " << ru.ru_maxrss/1024.0
+        << " " << files[r.idx] << endl;
+    }
+    cout << "c [batch] done, instances without a count: " << failed << endl;
+    return failed;
+}
+#endif
+
+}
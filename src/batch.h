@@ -0,0 +1,53 @@
+/*
+ ApproxMC
+
+ Copyright (c) 2019-2020, Mate Soos and Kuldeep S. Meel. All rights reserved
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <functional>
+
+namespace AppMCInt {
+
+struct BatchConf {
+    uint32_t jobs = 1;
+    uint32_t max_time = 0; // wall-clock seconds per instance, 0 = no limit
+    uint64_t max_mem = 0;  // MB of address space per instance, 0 = no limit
+};
+
+// One input file per line, empty lines and lines starting with # are skipped
+std::vector<std::string> read_batch_manifest(const std::string& fname);
+
+// Runs count(index, file) for every file, 'jobs' of them at a time. Each
+// runs in its own forked process so that the limits, a crash or running out
+// of memory only stop that instance. count() returns the count as text. One
+// line is printed per instance as it finishes. Returns the number of
+// instances that did not finish with a count.
+uint32_t run_batch(
+    const std::vector<std::string>& files,
+    const BatchConf& conf,
+    const std::function<std::string(size_t, const std::string&)>& count);
+
+}
@@ -0,0 +1,555 @@
+/*
+ ApproxMC
+
+ Copyright (c) 2019-2020, Mate Soos and Kuldeep S. Meel. All rights reserved
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+// Fast, unverified pre-check of a partial certificate written by approxmc.
+//
+// It checks everything certcheck_cnf_xor checks before it calls the UNSAT
+// oracle: every solution satisfies the formula and the XOR prefix of its
+// round, the projected solutions of a block are distinct, and the block sizes
+// are consistent with the threshold. Solutions are bit-packed and the formula
+// is evaluated on 64 solutions per word, with the clauses split across threads.
+// A certificate that passes still has to go through certcheck_cnf_xor.
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <cmath>
+#include <thread>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include <unordered_set>
+
+#include "time_mem.h"
+#include "src/argparse.hpp"
+
+using std::cout;
+using std::endl;
+using std::string;
+using std::vector;
+
+argparse::ArgumentParser program = argparse::ArgumentParser("certprecheck");
+uint32_t num_threads = 0;
+uint32_t verb = 1;
+
+struct Formula {
+    uint32_t nvars = 0;
+    // Literals in DIMACS form, constraint i is lits[start[i]..start[i+1])
+    vector<int32_t> cl_lits;
+    vector<size_t> cl_start = {0};
+    vector<int32_t> x_lits;
+    vector<size_t> x_start = {0};
+    vector<uint32_t> proj;
+};
+
+struct Block {
+    uint32_t round; // 0-based round the XORs are taken from
+    uint32_t num_xors;
+    bool below_thresh; // block must have less than thresh solutions
+    bool m0;
+    uint32_t first_sol;
+    uint32_t num_sols;
+};
+
+struct Certificate {
+    // True variables of solution i are true_vars[sol_start[i]..sol_start[i+1])
+    vector<uint32_t> true_vars;
+    vector<size_t> sol_start = {0};
+    vector<Block> blocks;
+    vector<uint32_t> ms;
+    // A shard of approxmc --certshards holds one round, given in its header
+    bool shard = false;
+    uint32_t first_round = 0;
+};
+
+[[noreturn]] static void fail(const string& msg)
+{
+    cout << "c ERROR: " << msg << endl;
+    cout << "s PRECHECK FAILED" << endl;
+    exit(1);
+}
+
+static string read_file(const string& fname, bool binary = false)
+{
+    std::ifstream f(fname, binary ? std::ios::binary : std::ios::in);
+    if (!f) {
+        std::cerr << "ERROR! Could not open file '" << fname
+        << "' for reading: " << strerror(errno) << endl;
+        exit(-1);
+    }
+    std::stringstream ss;
+    ss << f.rdbuf();
+    return ss.str();
+}
+
+// Minimal line-aware tokenizer over an in-memory file
+struct Scanner {
+    explicit Scanner(const string& _s) : s(_s) {}
+    const string& s;
+    size_t at = 0;
+    uint64_t line = 1;
+
+    void skip_blanks() {
+        while (at < s.size() && (s[at] == ' ' || s[at] == '\t' || s[at] == '\r')) at++;
+    }
+    void skip_line() {
+        while (at < s.size() && s[at] != '\n') at++;
+        if (at < s.size()) {at++; line++;}
+    }
+    // Skips empty lines, returns false at end of file
+    bool next_line() {
+        while (true) {
+            skip_blanks();
+            if (at >= s.size()) return false;
+            if (s[at] != '\n') return true;
+            at++; line++;
+        }
+    }
+    bool eol() {
+        skip_blanks();
+        return at >= s.size() || s[at] == '\n';
+    }
+    int64_t get_int() {
+        skip_blanks();
+        bool neg = false;
+        if (at < s.size() && (s[at] == '-' || s[at] == '+')) neg = s[at++] == '-';
+        if (at >= s.size() || s[at] < '0' || s[at] > '9') {
+            fail("expected an integer at line " + std::to_string(line));
+        }
+        int64_t val = 0;
+        while (at < s.size() && s[at] >= '0' && s[at] <= '9') {
+            val = val*10 + (s[at++] - '0');
+            if (val > std::numeric_limits<int32_t>::max()) {
+                fail("integer too large at line " + std::to_string(line));
+            }
+        }
+        return neg ? -val : val;
+    }
+    string get_word() {
+        skip_blanks();
+        size_t from = at;
+        while (at < s.size() && s[at] != ' ' && s[at] != '\t' && s[at] != '\r' && s[at] != '\n') at++;
+        return s.substr(from, at-from);
+    }
+};
+
+// Reads a zero-terminated list of literals, must end the line
+static void read_lits(Scanner& sc, const Formula& f, vector<int32_t>& lits, bool check_range = true)
+{
+    while (true) {
+        const int64_t l = sc.get_int();
+        if (l == 0) break;
+        if (check_range && std::abs(l) > f.nvars) {
+            fail("invalid literal at line " + std::to_string(sc.line));
+        }
+        lits.push_back(l);
+    }
+    if (!sc.eol()) fail("line not terminated with 0 at line " + std::to_string(sc.line));
+    sc.skip_line();
+}
+
+static Formula parse_formula(const string& fname)
+{
+    const string data = read_file(fname);
+    Scanner sc(data);
+    Formula f;
+    bool header = false;
+    vector<int32_t> ind;
+    while (sc.next_line()) {
+        if (sc.s[sc.at] == 'c') {
+            sc.at++;
+            if (!sc.eol() && sc.get_word() == "ind") {
+                read_lits(sc, f, ind, false);
+                continue;
+            }
+            sc.skip_line();
+            continue;
+        }
+        if (sc.s[sc.at] == 'p') {
+            sc.at++;
+            if (sc.get_word() != "cnf") fail("failed to parse DIMACS header");
+            f.nvars = sc.get_int();
+            sc.get_int();
+            header = true;
+            sc.skip_line();
+            continue;
+        }
+        if (!header) fail("missing DIMACS header");
+        if (sc.s[sc.at] == 'x') {
+            sc.at++;
+            read_lits(sc, f, f.x_lits);
+            f.x_start.push_back(f.x_lits.size());
+        } else {
+            read_lits(sc, f, f.cl_lits);
+            f.cl_start.push_back(f.cl_lits.size());
+        }
+    }
+    if (!header) fail("missing DIMACS header");
+
+    for (const auto v: ind) {
+        if (v <= 0 || (uint32_t)v > f.nvars) fail("invalid var in projection set");
+        f.proj.push_back(v);
+    }
+    if (f.proj.empty()) for (uint32_t v = 1; v <= f.nvars; v++) f.proj.push_back(v);
+    return f;
+}
+
+static void parse_block(Scanner& sc, const Formula& f, Certificate& cert, Block b)
+{
+    if (!sc.next_line()) fail("unable to parse solutions, file ended");
+    const int64_t n = sc.get_int();
+    if (n < 0) fail("negative solution count");
+    if (!sc.eol()) fail("unable to parse solutions at line " + std::to_string(sc.line));
+    sc.skip_line();
+
+    b.first_sol = cert.sol_start.size()-1;
+    b.num_sols = n;
+    // Unlisted variables are false and a later literal overrides an earlier
+    // one. Variables that are not in the formula do not matter.
+    vector<int8_t> val(f.nvars+1, 0);
+    vector<uint32_t> touched;
+    for (int64_t i = 0; i < n; i++) {
+        if (!sc.next_line()) fail("insufficient lines left");
+        while (true) {
+            const int64_t l = sc.get_int();
+            if (l == 0) break;
+            const uint32_t v = std::abs(l);
+            if (v > f.nvars) continue;
+            if (val[v] == 0) touched.push_back(v);
+            val[v] = l > 0 ? 1 : -1;
+        }
+        if (!sc.eol()) fail("line not terminated with 0 at line " + std::to_string(sc.line));
+        sc.skip_line();
+        for (const uint32_t v: touched) {
+            if (val[v] > 0) cert.true_vars.push_back(v);
+            val[v] = 0;
+        }
+        touched.clear();
+        cert.sol_start.push_back(cert.true_vars.size());
+    }
+    cert.blocks.push_back(b);
+}
+
+static Certificate parse_cert(const string& fname, const Formula& f)
+{
+    const string data = read_file(fname);
+    Scanner sc(data);
+    Certificate cert;
+
+    while (sc.next_line() && sc.s[sc.at] == 'c') {
+        sc.at++;
+        if (!sc.eol() && sc.get_word() == "round") {
+            cert.shard = true;
+            cert.first_round = sc.get_int();
+        }
+        sc.skip_line();
+    }
+    if (!sc.next_line() || sc.get_int() != 0 || !sc.eol()) fail("fail to parse round 0");
+    sc.skip_line();
+    parse_block(sc, f, cert, Block{0, 0, false, true, 0, 0});
+
+    for (uint32_t round = cert.first_round; sc.next_line(); round++) {
+        const int64_t m = sc.get_int();
+        if (!sc.eol()) fail("fail to parse round " + std::to_string(round));
+        sc.skip_line();
+        if (m < 1 || m > (int64_t)f.proj.size()) {
+            fail("round " + std::to_string(round) + " invalid value of m, need 1 <= m <= |S|");
+        }
+        cert.ms.push_back(m);
+        parse_block(sc, f, cert, Block{round, (uint32_t)m-1, false, false, 0, 0});
+        parse_block(sc, f, cert, Block{round, (uint32_t)m, true, false, 0, 0});
+    }
+    return cert;
+}
+
+// Same threshold as ApproxMCAnalysis.compute_thresh in the verified checker
+static uint64_t compute_thresh(double eps)
+{
+    if (eps > 1.0) eps = 1.0;
+    return std::ceil(1.0 + 9.84*(1.0+eps/(1.0+eps))*(1.0+1.0/eps)*(1.0+1.0/eps));
+}
+
+// Number of rounds, as find_t in the verified checker
+static uint32_t find_t(double delta)
+{
+    const double alpha = 0.14;
+    for (uint32_t t = 0; t < 256; t++) {
+        double bound = 0;
+        double binom = 1;
+        for (uint32_t i = 0; i <= t/2; i++) {
+            bound += binom*std::pow(0.5+alpha, i)*std::pow(0.5-alpha, t-i);
+            binom = binom*(t-i)/(i+1);
+        }
+        if (bound < delta) return t;
+    }
+    fail("cannot find number of rounds for delta");
+}
+
+static double rat_from_string(const string& s)
+{
+    vector<string> parts;
+    std::stringstream ss(s);
+    string part;
+    while (std::getline(ss, part, '/')) if (!part.empty()) parts.push_back(part);
+    if (parts.size() == 1) return std::stod(parts[0]);
+    if (parts.size() == 2) return std::stod(parts[0])/std::stod(parts[1]);
+    fail("cannot parse rational: " + s);
+}
+
+// Evaluates clauses [cl_from, cl_to) and XORs [x_from, x_to) on a batch of
+// solutions. cols has W words per variable, bit k of word w is solution 64*w+k.
+// Sets the bit of every solution that falsifies one of them in 'bad'.
+static void eval_batch(
+    const Formula& f, const vector<uint64_t>& cols, const uint32_t W,
+    size_t cl_from, size_t cl_to, size_t x_from, size_t x_to, uint64_t* bad)
+{
+    vector<uint64_t> acc(W);
+    for (size_t i = cl_from; i < cl_to; i++) {
+        std::fill(acc.begin(), acc.end(), 0);
+        for (size_t k = f.cl_start[i]; k < f.cl_start[i+1]; k++) {
+            const int32_t l = f.cl_lits[k];
+            const uint64_t flip = l < 0 ? ~0ULL : 0ULL;
+            const uint64_t* c = cols.data() + (size_t)std::abs(l)*W;
+            for (uint32_t w = 0; w < W; w++) acc[w] |= c[w] ^ flip;
+        }
+        for (uint32_t w = 0; w < W; w++) bad[w] |= ~acc[w];
+    }
+    for (size_t i = x_from; i < x_to; i++) {
+        std::fill(acc.begin(), acc.end(), 0);
+        for (size_t k = f.x_start[i]; k < f.x_start[i+1]; k++) {
+            const int32_t l = f.x_lits[k];
+            const uint64_t flip = l < 0 ? ~0ULL : 0ULL;
+            const uint64_t* c = cols.data() + (size_t)std::abs(l)*W;
+            for (uint32_t w = 0; w < W; w++) acc[w] ^= c[w] ^ flip;
+        }
+        // An XOR is satisfied if an odd number of its literals is true
+        for (uint32_t w = 0; w < W; w++) bad[w] |= ~acc[w];
+    }
+}
+
+static bool sol_value(const Certificate& cert, uint32_t sol, uint32_t var)
+{
+    for (size_t k = cert.sol_start[sol]; k < cert.sol_start[sol+1]; k++) {
+        if (cert.true_vars[k] == var) return true;
+    }
+    return false;
+}
+
+// Slow path, only used to report which constraint a bad solution falsifies
+static string first_violated(const Formula& f, const Certificate& cert, uint32_t sol)
+{
+    for (size_t i = 0; i+1 < f.cl_start.size(); i++) {
+        bool sat = false;
+        for (size_t k = f.cl_start[i]; k < f.cl_start[i+1] && !sat; k++) {
+            const int32_t l = f.cl_lits[k];
+            sat = sol_value(cert, sol, std::abs(l)) == (l > 0);
+        }
+        if (!sat) return "clause " + std::to_string(i+1);
+    }
+    return "an XOR constraint";
+}
+
+// Checks every solution in the certificate against the formula
+static void check_formula(const Formula& f, const Certificate& cert)
+{
+    const uint32_t num_sols = cert.sol_start.size()-1;
+    if (num_sols == 0) return;
+
+    // Keep the transposed batch below ~256MB
+    uint32_t W = (num_sols+63)/64;
+    const uint64_t max_words = (256ULL<<20)/8/(f.nvars+1);
+    W = std::max<uint32_t>(1, std::min<uint64_t>(W, max_words));
+    const uint32_t batch = W*64;
+
+    uint32_t threads = num_threads ? num_threads : std::thread::hardware_concurrency();
+    threads = std::max<uint32_t>(1, threads);
+    const size_t num_cls = f.cl_start.size()-1;
+    const size_t num_xors = f.x_start.size()-1;
+
+    vector<uint64_t> cols((size_t)(f.nvars+1)*W);
+    for (uint32_t from = 0; from < num_sols; from += batch) {
+        const uint32_t to = std::min(num_sols, from+batch);
+        std::fill(cols.begin(), cols.end(), 0);
+        for (uint32_t s = from; s < to; s++) {
+            const uint32_t w = (s-from)/64;
+            const uint64_t bit = 1ULL << ((s-from)%64);
+            for (size_t k = cert.sol_start[s]; k < cert.sol_start[s+1]; k++) {
+                const uint32_t v = cert.true_vars[k];
+                if (v <= f.nvars) cols[(size_t)v*W + w] |= bit;
+            }
+        }
+
+        vector<vector<uint64_t>> bad(threads, vector<uint64_t>(W, 0));
+        vector<std::thread> pool;
+        for (uint32_t t = 0; t < threads; t++) {
+            pool.emplace_back(eval_batch, std::cref(f), std::cref(cols), W,
+                num_cls*t/threads, num_cls*(t+1)/threads,
+                num_xors*t/threads, num_xors*(t+1)/threads,
+                bad[t].data());
+        }
+        for (auto& th: pool) th.join();
+
+        for (uint32_t s = from; s < to; s++) {
+            const uint32_t w = (s-from)/64;
+            const uint64_t bit = 1ULL << ((s-from)%64);
+            for (uint32_t t = 0; t < threads; t++) {
+                if (bad[t][w] & bit) {
+                    fail("solution " + std::to_string(s+1) + " of the certificate falsifies "
+                        + first_violated(f, cert, s));
+                }
+            }
+        }
+    }
+}
+
+static bool parity(uint64_t x)
+{
+    x ^= x >> 32; x ^= x >> 16; x ^= x >> 8;
+    x ^= x >> 4; x ^= x >> 2; x ^= x >> 1;
+    return x & 1;
+}
+
+static void check_blocks(
+    const Formula& f, const Certificate& cert, const string& rand, uint64_t thresh, uint32_t t)
+{
+    const uint32_t lS = f.proj.size();
+    const uint32_t width = lS == 0 ? 0 : lS-1;
+    const uint32_t words = (lS+63)/64;
+
+    vector<int32_t> pos_of_var(f.nvars+1, -1);
+    for (uint32_t i = 0; i < lS; i++) pos_of_var[f.proj[i]] = i;
+
+    auto rand_bit = [&](uint64_t i) -> bool {
+        return (((unsigned char)rand[i/8]) >> (7 - i%8)) & 1;
+    };
+
+    const Block& b0 = cert.blocks[0];
+    const bool exact = thresh && b0.num_sols < thresh;
+    if (!exact && thresh && cert.ms.size() < t) {
+        fail("certificate has " + std::to_string(cert.ms.size()) + " rounds, need " + std::to_string(t));
+    }
+    // The verified checker only looks at the first t rounds
+    uint64_t rounds_used = exact ? 0 : cert.ms.size();
+    if (thresh) rounds_used = std::min<uint64_t>(rounds_used, t);
+    if ((cert.first_round + rounds_used)*(lS+1)*width > (uint64_t)rand.size()*8) {
+        fail("not enough randomness");
+    }
+
+    vector<uint64_t> proj(words);
+    vector<uint64_t> hash(words);
+    for (const auto& b: cert.blocks) {
+        if (!b.m0 && b.round - cert.first_round >= rounds_used) break;
+        // With m = |S| the verified checker does not look at the second block
+        if (b.num_xors >= lS && b.below_thresh) continue;
+        const string where = b.m0 ? string("round 0 (no XORs)")
+            : "round " + std::to_string(b.round) + " with " + std::to_string(b.num_xors) + " XORs";
+
+        if (thresh && !b.m0) {
+            if (!b.below_thresh && b.num_sols < thresh) fail(where + ": too few solutions");
+            if (b.below_thresh && b.num_xors < lS && b.num_sols >= thresh) fail(where + ": too many solutions");
+        }
+
+        // Hashes of this block, bit-packed over the projection set
+        vector<vector<uint64_t>> hashes;
+        vector<bool> rhs;
+        for (uint32_t j = 0; j < b.num_xors; j++) {
+            const uint64_t base = ((uint64_t)b.round*width + j)*(lS+1);
+            std::fill(hash.begin(), hash.end(), 0);
+            for (uint32_t i = 0; i < lS; i++) if (rand_bit(base+i)) hash[i/64] |= 1ULL << (i%64);
+            hashes.push_back(hash);
+            rhs.push_back(rand_bit(base+lS));
+        }
+
+        std::unordered_set<string> seen;
+        for (uint32_t s = b.first_sol; s < b.first_sol+b.num_sols; s++) {
+            std::fill(proj.begin(), proj.end(), 0);
+            for (size_t k = cert.sol_start[s]; k < cert.sol_start[s+1]; k++) {
+                const uint32_t v = cert.true_vars[k];
+                if (v <= f.nvars && pos_of_var[v] >= 0) proj[pos_of_var[v]/64] |= 1ULL << (pos_of_var[v]%64);
+            }
+            for (uint32_t j = 0; j < hashes.size(); j++) {
+                uint64_t acc = 0;
+                for (uint32_t w = 0; w < words; w++) acc ^= proj[w] & hashes[j][w];
+                if (parity(acc) != rhs[j]) {
+                    fail(where + ": solution " + std::to_string(s+1) + " does not satisfy XOR " + std::to_string(j));
+                }
+            }
+            if (!seen.insert(string((const char*)proj.data(), words*8)).second) {
+                fail(where + ": solution " + std::to_string(s+1) + " is not distinct after projection");
+            }
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    program.add_argument("-v", "--verb")
+        .action([&](const auto& a) {verb = std::atoi(a.c_str());})
+        .default_value(verb)
+        .help("Verbosity");
+    program.add_argument("-t", "--threads")
+        .action([&](const auto& a) {num_threads = std::atoi(a.c_str());})
+        .default_value(num_threads)
+        .help("Number of threads evaluating the formula. 0 = all cores");
+    program.add_argument("eps").help("Tolerance the certificate was made with, e.g. 8/10. 0 = skip threshold checks");
+    program.add_argument("del").help("Confidence the certificate was made with, e.g. 2/10");
+    program.add_argument("inputfile").help("input CNF-XOR");
+    program.add_argument("randfile").help("random bits file");
+    program.add_argument("certfile").help("certificate file");
+    try {
+        program.parse_args(argc, argv);
+    } catch (const std::exception& err) {
+        std::cerr << err.what() << std::endl;
+        std::cerr << program;
+        exit(-1);
+    }
+
+    const double start_time = wallTime();
+    const double eps = rat_from_string(program.get<string>("eps"));
+    const double delta = rat_from_string(program.get<string>("del"));
+    const uint64_t thresh = eps > 0 ? compute_thresh(eps) : 0;
+
+    const Formula f = parse_formula(program.get<string>("inputfile"));
+    const string rand = read_file(program.get<string>("randfile"), true);
+    const Certificate cert = parse_cert(program.get<string>("certfile"), f);
+    // A shard is checked on its own, as a certificate with a single round
+    const uint32_t t = thresh ? (cert.shard ? 1 : find_t(delta)) : 0;
+    if (verb) {
+        cout << "c projection set length: " << f.proj.size() << endl;
+        if (thresh) cout << "c iters: " << t << endl << "c thresh: " << thresh << endl;
+        cout << "c clauses: " << f.cl_start.size()-1 << " xors: " << f.x_start.size()-1 << endl;
+        cout << "c certificate rounds: " << cert.ms.size()
+        << " solutions: " << cert.sol_start.size()-1 << endl;
+        cout << "c parsed T: " << std::fixed << std::setprecision(2) << (wallTime() - start_time) << endl;
+    }
+
+    check_blocks(f, cert, rand, thresh, t);
+    check_formula(f, cert);
+    if (verb) cout << "c checked T: " << std::fixed << std::setprecision(2) << (wallTime() - start_time) << endl;
+    cout << "s PRECHECK OK" << endl;
+    return 0;
+}
@@ -0,0 +1,136 @@
+/*
+ ApproxMC
+
+ Copyright (c) 2019-2020, Mate Soos and Kuldeep S. Meel. All rights reserved
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#include "checkpoint.h"
+
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <system_error>
+
+using std::string;
+using std::vector;
+
+namespace AppMCInt {
+
+// Text, one field per line, ends with 'end' so that a file that was cut
+// short is not used
+static const char* cp_header = "c approxmc checkpoint";
+static const uint32_t cp_version = 1;
+
+template<class T>
+static void write_list(std::ostream& out, const char* name, const vector<T>& xs)
+{
+    out << name << ' ' << xs.size();
+    for (const auto& x: xs) out << ' ' << x;
+    out << '\n';
+}
+
+template<class T>
+static bool read_list(std::istream& in, const char* name, vector<T>& xs)
+{
+    string field;
+    uint64_t num;
+    if (!(in >> field >> num) || field != name || num > (1ULL << 32)) return false;
+    xs.resize(num);
+    for (auto& x: xs) in >> x;
+    return (bool)in;
+}
+
+static bool read_field(std::istream& in, const char* name, string& val)
+{
+    string line;
+    if (!std::getline(in, line)) return false;
+    const string prefix = string(name) + ' ';
+    if (line.compare(0, prefix.size(), prefix) != 0) return false;
+    val = line.substr(prefix.size());
+    return true;
+}
+
+bool read_checkpoint(const string& fname, const string& key, Checkpoint& cp)
+{
+    std::ifstream in(fname, std::ios::binary);
+    if (!in) return false;
+
+    string line;
+    string val;
+    if (!std::getline(in, line) || line != cp_header) return false;
+    if (!read_field(in, "version", val) || val != std::to_string(cp_version)) return false;
+    if (!read_field(in, "key", cp.key) || cp.key != key) return false;
+
+    string field;
+    if (!(in >> field >> cp.next_round) || field != "round") return false;
+    if (!(in >> field >> cp.prev_measure) || field != "prev_measure") return false;
+    if (!read_list(in, "hashes", cp.num_hash_list)) return false;
+    if (!read_list(in, "counts", cp.num_count_list)) return false;
+    in >> std::ws;
+    if (!read_field(in, "rnd", cp.rnd_engine)) return false;
+    if (!(in >> field >> cp.cert_size) || field != "cert_size") return false;
+    if (!read_list(in, "cert_round_pos", cp.cert_round_pos)) return false;
+
+    uint64_t len;
+    if (!(in >> field >> len) || field != "cert_m0" || in.get() != '\n') return false;
+    cp.cert_m0.resize(len);
+    in.read(&cp.cert_m0[0], len);
+    if (!read_list(in, "models", cp.models)) return false;
+    if (!(in >> field) || field != "end") return false;
+
+    return cp.num_hash_list.size() == cp.num_count_list.size()
+        && cp.num_hash_list.size() <= cp.next_round;
+}
+
+// Written to a temporary file first, a run that is killed while writing
+// leaves the previous checkpoint in place
+bool write_checkpoint(const string& fname, const Checkpoint& cp)
+{
+    const string tmp_fname = fname + ".tmp";
+    std::ofstream out(tmp_fname, std::ios::binary);
+    if (!out) return false;
+
+    out << cp_header << '\n'
+    << "version " << cp_version << '\n'
+    << "key " << cp.key << '\n'
+    << "round " << cp.next_round << '\n'
+    << "prev_measure " << cp.prev_measure << '\n';
+    write_list(out, "hashes", cp.num_hash_list);
+    write_list(out, "counts", cp.num_count_list);
+    out << "rnd " << cp.rnd_engine << '\n'
+    << "cert_size " << cp.cert_size << '\n';
+    write_list(out, "cert_round_pos", cp.cert_round_pos);
+    out << "cert_m0 " << cp.cert_m0.size() << '\n' << cp.cert_m0;
+    out << "models " << cp.models.size() << '\n';
+    for (const auto& m: cp.models) out << m << '\n';
+    out << "end" << '\n';
+    out.close();
+
+    std::error_code ec;
+    if (out) std::filesystem::rename(tmp_fname, fname, ec);
+    if (!out || ec) {
+        std::filesystem::remove(tmp_fname, ec);
+        return false;
+    }
+    return true;
+}
+
+}
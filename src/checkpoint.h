@@ -0,0 +1,65 @@
+/*
+ ApproxMC
+
+ Copyright (c) 2019-2020, Mate Soos and Kuldeep S. Meel. All rights reserved
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+namespace AppMCInt {
+
+// State of Counter::count() between two rounds, enough to go on with the
+// next round with a solver built from the same formula
+struct Checkpoint {
+    std::string key; // options and formula, must match to resume
+    uint32_t next_round = 0;
+    int64_t prev_measure = 0;
+    std::vector<uint64_t> num_hash_list;
+    std::vector<int64_t> num_count_list;
+    std::string rnd_engine; // as written by operator<<
+    std::vector<std::string> models; // kept across rounds, one char per var
+
+    // Certificate
+    uint64_t cert_size = 0;
+    std::vector<uint64_t> cert_round_pos;
+    std::string cert_m0;
+};
+
+// 64-bit FNV-1a, for the part of the key that identifies the formula
+struct Digest {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    void add(const uint32_t x) {
+        for (int i = 0; i < 4; i++) {
+            h ^= (x >> (8*i)) & 0xff;
+            h *= 0x100000001b3ULL;
+        }
+    }
+};
+
+// Returns false if the file is missing, was cut short or has another key
+bool read_checkpoint(const std::string& fname, const std::string& key, Checkpoint& cp);
+bool write_checkpoint(const std::string& fname, const Checkpoint& cp);
+
+}
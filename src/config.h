@@ -47,12 +47,18 @@ struct Config {
     double var_elim_ratio = 1.6;
     int reuse_models = 1;
     std::string logfilename = "";
+    int log_fd = -1; //log to this fd instead of logfilename
     std::string randfilename = "";
     std::string certfilename = "";
+    int cert_shards = 0;
     int cms_detach_xor = 1;
     int dump_intermediary_cnf = 0;
     int debug = 0;
     int force_sol_extension = false;
+    double max_time = 0; //wall-clock seconds count() may take, 0 = no limit
+    std::string checkpoint_fname = "";
+    int resume = 0; //continue from checkpoint_fname if it is there
+    int incremental = 0; //start a recount from the rounds of the last count
 
     std::vector<uint32_t> sampl_vars;
     bool sampl_vars_set = false;
@@ -42,6 +42,8 @@
 #include <array>
 #include <cmath>
 #include <complex>
+#include <cstdio>
+#include <filesystem>
 
 #include "counter.h"
 #include "time_mem.h"
@@ -67,6 +69,21 @@ bool Counter::solver_add_clause(const vector<Lit>& cl) {
     return solver->add_clause(cl);
 }
 
+bool Counter::solver_add_clause(const Lit* begin, const Lit* end) {
+    tmp_cl.assign(begin, end);
+    digest_input(0, tmp_cl);
+    return solver_add_clause(tmp_cl);
+}
+
+bool Counter::solver_add_dimacs_clause(const int32_t* begin, const int32_t* end) {
+    tmp_cl.clear();
+    for (const int32_t* l = begin; l != end; l++) {
+        tmp_cl.push_back(Lit(std::abs(*l)-1, *l < 0));
+    }
+    digest_input(0, tmp_cl);
+    return solver_add_clause(tmp_cl);
+}
+
 
 bool Counter::solver_add_xor_clause(const vector<Lit>& lits, const bool rhs) {
     if (conf.dump_intermediary_cnf) xors_in_solver.push_back(make_pair(lits, rhs));
@@ -113,6 +130,7 @@ Hash Counter::add_hash(uint32_t hash_index, SparseData& sparse_data)
     }
 
     solver->new_var();
+    own_vars++;
     const uint32_t act_var = solver->nVars()-1;
     bool rhs;
     if (randfile.is_open()) {
@@ -141,7 +159,8 @@ void Counter::ban_one(const uint32_t act_var, const vector<lbool>& model)
 uint64_t Counter::add_glob_banning_cls(
     const HashesModels* hm
     , const uint32_t act_var
-    , const uint32_t num_hashes)
+    , const uint32_t num_hashes
+    , vector<uint32_t>* banned)
 {
     uint64_t repeat = 0;
     uint64_t checked = 0;
@@ -157,6 +176,7 @@ uint64_t Counter::add_glob_banning_cls(
 
             if (sm.hash_num >= num_hashes) {
                 ban_one(act_var, sm.model);
+                if (banned) banned->push_back(i);
                 repeat++;
             } else {
                 //Model has to fit all hashes
@@ -174,6 +194,7 @@ uint64_t Counter::add_glob_banning_cls(
                 if (ok) {
                     //cout << "Found repeat model, had to check " << checked << " hashes" << endl;
                     ban_one(act_var, sm.model);
+                    if (banned) banned->push_back(i);
                     repeat++;
                 }
             }
@@ -225,36 +246,69 @@ SolNum Counter::bounded_sol_count(
         const uint32_t iter,
         HashesModels* hm
 ) {
+    PhaseTimer timer(phases, "bounded_sol_count");
+    TraceSpan span("bounded_sol_count", "hashes", hash_cnt);
+    const SolverCounters start_counters = get_solver_counters();
     verb_print(1, "[appmc] "
-        "[ " << std::setw(7) << std::setprecision(2) << std::fixed << (cpuTimeTotal()-start_time) << " ]"
+        "[ " << std::setw(7) << std::setprecision(2) << std::fixed << (wallTime()-start_time) << " ]"
         << " bounded_sol_count looking for " << std::setw(4) << max_solutions << " solutions"
         << " -- hashes active: " << hash_cnt);
 
     //Set up things for adding clauses that can later be removed
-    vector<Lit> new_assumps;
+    vector<Lit> new_assumps = user_assumps;
     if (assumps) {
         assert(assumps->size() == hash_cnt);
-        new_assumps = *assumps;
+        new_assumps.insert(new_assumps.end(), assumps->begin(), assumps->end());
     } else assert(hash_cnt == 0);
     solver->new_var();
+    own_vars++;
     const uint32_t sol_ban_var = solver->nVars()-1;
     new_assumps.push_back(Lit(sol_ban_var, true));
 
     if (conf.simplify >= 2) {
         verb_print(2, "[appmc] inter-simplifying");
-        double my_time = cpuTime();
+        PhaseTimer simp_timer(phases, "inter_simplify");
+        TraceSpan simp_span("inter_simplify");
         solver->simplify(&new_assumps);
-        total_inter_simp_time += cpuTime() - my_time;
+        total_inter_simp_time += simp_timer.wall();
+        if (events.is_open()) {
+            events.begin("inter_simplify", wallTime()-start_time)
+            .add("round", iter).add("hashes", hash_cnt)
+            .add("wall", simp_timer.wall()).add("cpu", simp_timer.cpu())
+            .write();
+        }
         verb_print(1, "[appmc] inter-simp finished, total simp time: " << total_inter_simp_time);
     }
 
     cnf_dump_no = 0;
-    const uint64_t repeat = (conf.reuse_models ? add_glob_banning_cls(hm, sol_ban_var, hash_cnt) : 0);
+    vector<uint32_t>* cell = nullptr;
+    if (hm && !conf.certfilename.empty()) {
+        cell = &hm->cells[hash_cnt];
+        cell->clear();
+    }
+    const uint64_t repeat = (conf.reuse_models ? add_glob_banning_cls(hm, sol_ban_var, hash_cnt, cell) : 0);
+    stats.repeated_models += repeat;
     uint64_t solutions = repeat;
-    double last_found_time = cpuTimeTotal();
+    double last_found_time = wallTime();
     vector<vector<lbool>> models;
     while (solutions < max_solutions) {
-        lbool ret = solver->solve(&new_assumps, !conf.force_sol_extension & conf.certfilename.empty());
+        if (must_stop()) break;
+        lbool ret;
+        {
+            TraceSpan solve_span("solve");
+            ret = solver->solve(&new_assumps, !conf.force_sol_extension);
+        }
+        stats.sat_calls++;
+        if (ret == l_Undef) {
+            // interrupt_asap() stops the solver, it should not give up otherwise
+            if (!interrupt_flag) {
+                cout << "[appmc] ERROR: the SAT solver gave up without being interrupted,"
+                " stopping the count" << endl;
+                stopped_early = true;
+            }
+            must_stop();
+            break;
+        }
         assert(ret == l_False || ret == l_True);
         if ((conf.dump_intermediary_cnf >= 2 && ret == l_True) ||
             (conf.dump_intermediary_cnf >= 1 && ret == l_False)) {
@@ -267,13 +321,13 @@ SolNum Counter::bounded_sol_count(
             else cout << " No more. " << std::setw(3) << "";
             cout << " T: "
             << std::setw(7) << std::setprecision(2) << std::fixed
-            << (cpuTimeTotal()-start_time)
+            << (wallTime()-start_time)
             << " -- hashes act: " << hash_cnt
             << " -- T since last: "
             << std::setw(7) << std::setprecision(2) << std::fixed
-            << (cpuTimeTotal()-last_found_time) << endl;
+            << (wallTime()-last_found_time) << endl;
             if (conf.verb >= 4) solver->print_stats();
-            last_found_time = cpuTimeTotal();
+            last_found_time = wallTime();
         }
         if (ret != l_True) break;
 
@@ -299,39 +353,113 @@ SolNum Counter::bounded_sol_count(
     //Save global models
     if (hm && (conf.reuse_models || !conf.certfilename.empty())) {
         for (const auto& model: models) {
+            if (cell) cell->push_back(hm->glob_model.size());
             hm->glob_model.emplace_back(SavedModel(model, hash_cnt));
         }
     }
+    if (cell && cell->size() > max_solutions) cell->resize(max_solutions);
 
     //Remove solution banning
     vector<Lit> cl_that_removes;
     cl_that_removes.push_back(Lit(sol_ban_var, false));
     solver_add_clause(cl_that_removes);
 
+    if (events.is_open()) {
+        events.begin("bounded_sol_count", wallTime()-start_time)
+        .add("round", iter).add("hashes", hash_cnt)
+        .add("sols", std::min<uint64_t>(solutions, max_solutions)).add("repeat", repeat)
+        .add("full", solutions >= max_solutions).add("stopped", stopped_early)
+        .add("wall", timer.wall()).add("cpu", timer.cpu());
+        add_solver_counters(start_counters);
+        events.write();
+    }
+
     return SolNum(solutions, repeat);
 }
 
-ApproxMC::SolCount Counter::solve() {
-    orig_num_vars = solver->nVars();
-    start_time = cpuTimeTotal();
-
-    open_logfile();
+ApproxMC::SolCount Counter::solve(const vector<Lit>& assumps) {
+    orig_num_vars = solver->nVars() - own_vars;
+    user_assumps = assumps;
+    start_time = wallTime();
+    const double start_cpu = cpuTimeTotal();
+    phases.clear();
+    stopped_early = false;
+    effective_delta = conf.delta;
+    stats = ApproxMC::CountStats();
+    const SolverCounters start_counters = read_solver_counters();
+    cert_round_pos.clear();
+
+    Checkpoint cp;
+    const bool resumed = read_resume_checkpoint(cp);
+    open_logfile(resumed);
     open_randfile();
-    open_certfile();
+    if (!conf.cert_shards) open_certfile(resumed);
     rnd_engine.seed(conf.seed);
 
-    ApproxMC::SolCount sol_count = count();
+    ApproxMC::SolCount sol_count = count(resumed ? &cp : nullptr);
+    fill_stats(start_counters, start_cpu);
+    if (events.is_open()) {
+        events.begin("estimate", wallTime()-start_time)
+        .add("valid", sol_count.valid)
+        .add("cell", sol_count.cellSolCount).add("hashes", sol_count.hashCount)
+        .add("rounds", rounds_done).add("stopped_early", stopped_early)
+        .add("effective_delta", effective_delta)
+        .add("wall", wallTime()-start_time).add("cpu", cpuTimeTotal()-start_cpu)
+        .add("peak_mb", memPeakTotal() >> 20)
+        .write();
+        events.close();
+    }
     if (sol_count.hashCount == 0 && sol_count.cellSolCount == 0)
         verb_print(1, "[appmc] Formula was UNSAT");
     if (conf.verb >= 2) solver->print_stats();
 
     randfile.close();
     certfile.close();
+    if (stopped_early && rounds_done < cert_round_pos.size()) {
+        std::filesystem::resize_file(conf.certfilename, cert_round_pos[rounds_done]);
+    }
+    interrupt_flag = false;
 
-    verb_print(1, "[appmc] ApproxMC T: " << (cpuTimeTotal() - start_time) << " s");
+    verb_print(1, "[appmc] ApproxMC T: " << (wallTime() - start_time) << " s"
+        << " CPU T: " << (cpuTimeTotal() - start_cpu) << " s"
+        << " peak mem: " << (memPeakTotal() >> 20) << " MB");
+    if (conf.verb) phases.print(cout, "c [appmc] ");
     return sol_count;
 }
 
+// Back to the state of a new Counter for a new formula. The vectors keep
+// their memory, the solver is the caller's.
+void Counter::reset()
+{
+    stopped_early = false;
+    rounds_done = 0;
+    effective_delta = 0;
+    stats = ApproxMC::CountStats();
+    progress = nullptr;
+    num_hash_list.clear();
+    num_count_list.clear();
+    phases.clear();
+    events.close();
+    randfile.close();
+    randfile.clear();
+    certfile.close();
+    certfile.clear();
+    cert_m0.clear();
+    cert_round_pos.clear();
+    interrupt_flag = false;
+    user_assumps.clear();
+    tmp_cl.clear();
+    own_vars = 0;
+    input_digest = Digest();
+    incr = IncrementalState();
+    warm_start = false;
+    total_inter_simp_time = 0;
+    cnf_dump_no = 0;
+    base_rand = 0;
+    cls_in_solver.clear();
+    xors_in_solver.clear();
+}
+
 vector<Lit> Counter::set_num_hashes(
     uint32_t num_wanted,
     map<uint64_t, Hash>& hashes,
@@ -354,6 +482,9 @@ vector<Lit> Counter::set_num_hashes(
 
 void Counter::simplify()
 {
+    PhaseTimer timer(phases, "simplify");
+    TraceSpan span("simplify");
+    const SolverCounters start_counters = get_solver_counters();
     verb_print(1, "[appmc] simplifying");
     solver->set_sls(1);
     solver->set_intree_probe(1);
@@ -361,10 +492,17 @@ void Counter::simplify()
     solver->set_full_bve(1);
     solver->set_scc(1);
 
-    solver->simplify();
+    solver->simplify(&user_assumps);
 
     solver->set_sls(0);
     solver->set_full_bve(0);
+
+    if (events.is_open()) {
+        events.begin("simplify", wallTime()-start_time)
+        .add("wall", timer.wall()).add("cpu", timer.cpu());
+        add_solver_counters(start_counters);
+        events.write();
+    }
 }
 
 //Set up probabilities, threshold and measurements
@@ -413,15 +551,12 @@ bool Counter::find_one_solution(Config _conf)
     // certification
     conf = _conf;
     orig_num_vars = solver->nVars();
-    open_certfile();
+    if (conf.cert_shards) open_cert_shard(0, 0);
+    else open_certfile(false);
     certfile << '0' << endl;
     if (ret == l_True) {
         certfile << '1' << endl;
-        const vector<lbool> model = solver->get_model();
-        for (uint32_t var = 0; var < orig_num_vars; var++) {
-            certfile << Lit(var, model[var] == l_False) << ' ';
-        }
-        certfile << '0' << endl;
+        print_cert_model(certfile, solver->get_model());
     } else {
         certfile << '0' << endl;
     }
@@ -430,7 +565,7 @@ bool Counter::find_one_solution(Config _conf)
     return ret == l_True;
 }
 
-ApproxMC::SolCount Counter::count()
+ApproxMC::SolCount Counter::count(const Checkpoint* resume_from)
 {
     const int64_t hash_cnt = conf.start_iter;
 
@@ -444,35 +579,82 @@ ApproxMC::SolCount Counter::count()
     int64_t prev_measure = hash_cnt;
     num_hash_list.clear();
     num_count_list.clear();
+    IncrementalState next_incr;
+    warm_start = false;
+    if (conf.incremental) {
+        next_incr.key = incremental_key();
+        warm_start = incr.valid && incr.key == next_incr.key;
+        if (warm_start) verb_print(1, "[appmc] Recount, rounds start from the last count");
+    }
+    uint32_t first_round = 0;
+    if (resume_from) {
+        resume_from_checkpoint(*resume_from, prev_measure, hm);
+        first_round = resume_from->next_round;
+    }
+    if (events.is_open()) {
+        events.begin("start", wallTime()-start_time)
+        .add("vars", orig_num_vars).add("sampl_vars", (uint64_t)conf.sampl_vars.size())
+        .add("assumptions", (uint64_t)user_assumps.size())
+        .add("epsilon", conf.epsilon).add("delta", conf.delta).add("seed", conf.seed)
+        .add("threshold", threshold).add("rounds", measurements)
+        .add("sparse", sparse_data.table_no != -1).add("first_round", first_round)
+        .add("warm", warm_start)
+        .write();
+    }
 
     //See Algorithm 1 in paper "Algorithmic Improvements in Approximate Counting
     //for Probabilistic Inference: From Linear to Logarithmic SAT Calls"
     //https://www.ijcai.org/Proceedings/16/Papers/503.pdf
-    for (uint32_t j = 0; j < measurements; j++) {
+    for (uint32_t j = first_round; j < measurements; j++) {
+        TraceSpan round_span("round", "round", j);
+        if (warm_start) warm_start_round(j, prev_measure, hm);
         if (prev_measure && prev_measure == conf.sampl_vars.size()) {
             prev_measure--;
         }
 
         one_measurement_count(prev_measure, j, sparse_data, &hm);
+        if (stopped_early) {
+            stop_early(j);
+            break;
+        }
+
+        if (events.is_open()) {
+            events.begin("round", wallTime()-start_time)
+            .add("round", j).add("hashes", num_hash_list.back())
+            .add("cell", num_count_list.back())
+            .add("peak_mb", memPeakTotal() >> 20)
+            .write();
+            events.flush();
+        }
 
         // certification
-        if (certfile.is_open()) {
-            // initialization
-            if(j == 0 && prev_measure >= 1) {
-                certfile << 0 << endl;
-                certfile << threshold+1 << endl;
-                assert(print_models(hm, 0) == threshold+1);
-            }
-            
-            certfile << prev_measure << endl; 
-            if (prev_measure >= 1) {
-                certfile << threshold+1 << endl;
-                assert(print_models(hm, prev_measure-1) == threshold+1);
-            }
-            if (prev_measure < conf.sampl_vars.size()) {
-                certfile << num_count_list.back() << endl; 
-                assert(print_models(hm, prev_measure) == num_count_list.back());
+        if (!conf.certfilename.empty() && !write_cert_round(hm, j, prev_measure)) {
+            // The round cannot be certified, the count keeps the ones before it
+            num_hash_list.pop_back();
+            num_count_list.pop_back();
+            if (conf.cert_shards) {
+                certfile.close();
+                const string fname = conf.certfilename + "." + std::to_string(j);
+                std::remove(fname.c_str());
             }
+            stopped_early = true;
+            stop_early(j);
+            break;
+        }
+
+        if (conf.incremental) {
+            next_incr.hash_counts.push_back(prev_measure);
+            next_incr.hashes.push_back(hm.hashes);
+            next_incr.models.push_back(hm.glob_model);
+        }
+
+        if (progress) {
+            ApproxMC::CountProgress p;
+            p.rounds_done = num_hash_list.size();
+            p.rounds = measurements;
+            p.estimate = calc_est_count();
+            p.elapsed = wallTime()-start_time;
+            progress(p);
         }
 
         if (prev_measure == 0) {
@@ -481,48 +663,393 @@ ApproxMC::SolCount Counter::count()
             break;
         }
         sparse_data.next_index = 0;
-        if (conf.simplify >= 1 && j+1 < measurements) simplify();
         hm.clear();
+
+        // After an odd number of rounds, the counts stop_early() keeps. It
+        // is written before stopping, so a stop right after this round can
+        // go on from it.
+        if (!conf.checkpoint_fname.empty() && j % 2 == 0 && j+1 < measurements) {
+            write_round_checkpoint(j+1, prev_measure, hm);
+        }
+        if (j+1 < measurements && must_stop()) {
+            stop_early(j+1);
+            break;
+        }
+        if (conf.simplify >= 1 && j+1 < measurements) simplify();
     }
+    rounds_done = num_hash_list.size();
+    incr = IncrementalState();
+    if (conf.incremental && !stopped_early) {
+        incr = std::move(next_incr);
+        incr.valid = true;
+    }
+    if (!conf.checkpoint_fname.empty() && !stopped_early) {
+        std::remove(conf.checkpoint_fname.c_str());
+    }
+    if (stopped_early && rounds_done == 0) return ApproxMC::SolCount();
     assert(!num_hash_list.empty() && "UNSAT should not be possible");
 
     return calc_est_count();
 }
 
-int Counter::print_models(HashesModels hm, int64_t hashCount)
+// Writes the certificate part of round 'iter' that found 'measure' hashes.
+// Returns false if a model could not be extended.
+bool Counter::write_cert_round(const HashesModels& hm, const uint32_t iter, const int64_t measure)
 {
-    // number of solutions
-    int count = 0;
+    PhaseTimer timer(phases, "cert");
+    TraceSpan span("cert", "round", iter);
+    uint32_t printed = 0;
+
+    // Cell at 0 hashes, it is checked before any of the rounds
+    if (iter == 0 && measure >= 1) {
+        std::stringstream m0;
+        m0 << 0 << '\n' << threshold+1 << '\n';
+        if (!print_models(m0, hm, 0, printed)) return false;
+        assert(printed == threshold+1);
+        cert_m0 = m0.str();
+        if (!conf.cert_shards) certfile << cert_m0;
+    }
+    if (conf.cert_shards) open_cert_shard(iter, measure);
+    else {
+        cert_round_pos.push_back(certfile.tellp());
+    }
 
-    for (uint32_t i = 0; count < threshold+1 && i < hm.glob_model.size(); i++) {
-        const SavedModel& sm = hm.glob_model[i];
-        bool ok = true;
-        if (conf.reuse_models) {
-            if (sm.hash_num < hashCount) {
-                for (const auto& h: hm.hashes) {
-                    if (h.first < hashCount) {
-                        ok &= check_model_against_hash(h.second, sm.model);
-                        if (!ok) break;
-                    }
-                }
-            }
-        } else {
-            if (sm.hash_num != hashCount) {
-                ok = false;
-            }
+    certfile << measure << '\n';
+    if (measure >= 1) {
+        certfile << threshold+1 << '\n';
+        if (!print_models(certfile, hm, measure-1, printed)) return false;
+        assert(printed == threshold+1);
+    }
+    if (measure < (int64_t)conf.sampl_vars.size()) {
+        certfile << num_count_list.back() << '\n';
+        if (!print_models(certfile, hm, measure, printed)) return false;
+        assert(printed == num_count_list.back());
+    }
+    (void)printed;
+    if (conf.cert_shards) certfile.close();
+    else certfile.flush();
+    return true;
+}
+
+// Checked before every SAT call of the rounds
+bool Counter::must_stop()
+{
+    if (stopped_early) return true;
+    if (interrupt_flag) {
+        verb_print(1, "[appmc] Interrupted, stopping");
+        stopped_early = true;
+    } else if (conf.max_time > 0) {
+        if (wallTime() - start_time > conf.max_time) {
+            verb_print(1, "[appmc] Time limit of " << conf.max_time << " s reached, stopping");
+            stopped_early = true;
         }
+    }
+    return stopped_early;
+}
+
+// The count is the median of the rounds that are done, the one that was
+// stopped is thrown away. An even number of rounds is no more likely to be
+// right than one less, so the last one is then dropped, also from the
+// certificate, which solve() cuts back to the rounds of the count. It then
+// checks with any delta above the effective one.
+void Counter::stop_early(uint32_t rounds)
+{
+    if (rounds % 2 == 0 && rounds > 0) {
+        rounds--;
+        num_hash_list.pop_back();
+        num_count_list.pop_back();
+        if (conf.cert_shards) {
+            const string fname = conf.certfilename + "." + std::to_string(rounds);
+            std::remove(fname.c_str());
+        }
+    }
+    if (rounds == 0) {
+        effective_delta = 1;
+        verb_print(1, "[appmc] Stopped before the first round was done, no count");
+        return;
+    }
+    const auto& confs = constants.iterationConfidences;
+    effective_delta = 1.0 - confs[std::min<size_t>(rounds/2, confs.size()-1)];
+    verb_print(1, "[appmc] Stopped early, count is the median of " << rounds
+        << " rounds, effective delta: " << effective_delta);
+}
+
+// Only needed for the events, the stats of a count take them once
+Counter::SolverCounters Counter::get_solver_counters()
+{
+    if (!events.is_open()) return SolverCounters();
+    return read_solver_counters();
+}
+
+Counter::SolverCounters Counter::read_solver_counters()
+{
+    SolverCounters sc;
+    sc.conflicts = solver->get_sum_conflicts();
+    sc.propagations = solver->get_sum_propagations();
+    sc.decisions = solver->get_sum_decisions();
+    return sc;
+}
+
+// Adds what the solver did since 'start' to the event being written
+void Counter::fill_stats(const SolverCounters& start, const double start_cpu)
+{
+    const SolverCounters now = read_solver_counters();
+    stats.conflicts = now.conflicts - start.conflicts;
+    stats.propagations = now.propagations - start.propagations;
+    stats.decisions = now.decisions - start.decisions;
+    stats.round_hashes.assign(num_hash_list.begin(), num_hash_list.end());
+    stats.round_cells.assign(num_count_list.begin(), num_count_list.end());
+    stats.seed = conf.seed;
+    for (const auto& p: phases.all()) {
+        ApproxMC::CountPhase cp;
+        cp.name = p.name;
+        cp.calls = p.calls;
+        cp.wall = p.wall;
+        cp.cpu = p.cpu;
+        stats.phases.push_back(cp);
+    }
+    stats.wall = wallTime()-start_time;
+    stats.cpu = cpuTimeTotal()-start_cpu;
+    stats.peak_mem = memPeakTotal();
+}
+
+void Counter::add_solver_counters(const SolverCounters& start)
+{
+    const SolverCounters now = get_solver_counters();
+    events.add("conflicts", now.conflicts - start.conflicts)
+    .add("propagations", now.propagations - start.propagations)
+    .add("decisions", now.decisions - start.decisions)
+    .add("peak_mb", memPeakTotal() >> 20);
+}
+
+void Counter::digest_input(const uint32_t kind, const vector<Lit>& lits)
+{
+    if (incr.valid) {
+        if (kind == 0) incr.new_cls.push_back(lits);
+        else incr.new_xors.push_back(make_pair(lits, kind == 2));
+    }
+    input_digest.add(kind);
+    input_digest.add(lits.size());
+    for (const Lit l: lits) input_digest.add(l.toInt());
+}
+
+// Everything a recount needs to be the same as the last count, but the formula
+string Counter::incremental_key()
+{
+    std::stringstream ss;
+    ss << std::setprecision(17) << "vars=";
+    for (const uint32_t v: conf.sampl_vars) ss << v << ',';
+    ss << " assumps=";
+    for (const Lit l: user_assumps) ss << l.toInt() << ',';
+    ss << " eps=" << conf.epsilon << " del=" << conf.delta << " seed=" << conf.seed
+    << " sparse=" << conf.sparse << " reuse=" << conf.reuse_models
+    << " start=" << conf.start_iter << " rand=" << conf.randfilename;
+    return ss.str();
+}
+
+// Clauses were only added since the last count, so the hash count of this
+// round there is where the search starts. The round's hashes are the same,
+// so its models that still satisfy the formula need no SAT call.
+void Counter::warm_start_round(const uint32_t iter, int64_t& prev_measure, HashesModels& hm)
+{
+    if (iter >= incr.hash_counts.size()) return;
+    prev_measure = incr.hash_counts[iter];
+    hm.hashes = incr.hashes[iter];
+
+    vector<char> in_sampl(solver->nVars(), 0);
+    for (const uint32_t v: conf.sampl_vars) in_sampl[v] = 1;
+    vector<SavedModel> models;
+    for (const auto& sm: incr.models[iter]) {
+        if (model_survives(sm.model, in_sampl)) models.push_back(sm);
+    }
+    verb_print(2, "[appmc] Round " << iter << " starts at hash count " << prev_measure
+        << " with " << models.size() << " of " << incr.models[iter].size() << " models");
+    std::swap(hm.glob_model, models);
+}
 
-        if (ok) {
-            count++;
-            // may not print the full model if Arjun simplifies the formula
-            for (uint32_t var = 0; var < orig_num_vars; var++) {
-                certfile << Lit(var, sm.model[var] == l_False) << ' ';
+// Only the sampling variables of a model are sure to be part of a solution,
+// the new constraints must be satisfied by those
+bool Counter::model_survives(const vector<lbool>& model, const vector<char>& in_sampl) const
+{
+    for (const auto& cl: incr.new_cls) {
+        bool sat = false;
+        for (const Lit l: cl) {
+            if (l.var() < in_sampl.size() && in_sampl[l.var()]
+                && model[l.var()] == (l.sign() ? l_False : l_True))
+            {
+                sat = true;
+                break;
             }
-            certfile << '0' << endl;
         }
+        if (!sat) return false;
+    }
+    for (const auto& x: incr.new_xors) {
+        bool val = false;
+        for (const Lit l: x.first) {
+            if (l.var() >= in_sampl.size() || !in_sampl[l.var()]) return false;
+            val ^= (model[l.var()] == l_True) ^ l.sign();
+        }
+        if (val != x.second) return false;
+    }
+    return true;
+}
+
+// Everything the rounds depend on. The solver itself is not in the
+// checkpoint, it is built again from the same formula
+string Counter::checkpoint_key()
+{
+    Digest sampl;
+    for (const uint32_t v: conf.sampl_vars) sampl.add(v);
+    Digest assumps;
+    for (const Lit l: user_assumps) assumps.add(l.toInt());
+    std::stringstream ss;
+    ss << std::setprecision(17)
+    << "appmc=" << get_version_sha1()
+    << " vars=" << orig_num_vars
+    << " formula=" << std::hex << input_digest.h << " sampl=" << sampl.h
+    << " assumps=" << assumps.h << std::dec
+    << " eps=" << conf.epsilon << " del=" << conf.delta << " seed=" << conf.seed
+    << " sparse=" << conf.sparse << " reuse=" << conf.reuse_models
+    << " start=" << conf.start_iter << " rand=" << conf.randfilename
+    << " cert=" << conf.certfilename << " shards=" << conf.cert_shards;
+    return ss.str();
+}
+
+bool Counter::read_resume_checkpoint(Checkpoint& cp)
+{
+    if (!conf.resume || conf.checkpoint_fname.empty()) return false;
+    if (!read_checkpoint(conf.checkpoint_fname, checkpoint_key(), cp)) {
+        verb_print(1, "[appmc] No usable checkpoint in " << conf.checkpoint_fname
+            << ", starting from the first round");
+        return false;
+    }
+    if (!conf.certfilename.empty() && !conf.cert_shards) {
+        std::error_code ec;
+        const auto size = std::filesystem::file_size(conf.certfilename, ec);
+        if (ec || size < cp.cert_size) {
+            verb_print(1, "[appmc] Certificate " << conf.certfilename
+                << " is shorter than at the checkpoint, starting from the first round");
+            return false;
+        }
+        std::filesystem::resize_file(conf.certfilename, cp.cert_size);
     }
+    return true;
+}
 
-    return count;
+void Counter::resume_from_checkpoint(
+    const Checkpoint& cp, int64_t& prev_measure, HashesModels& hm)
+{
+    verb_print(1, "[appmc] Resuming from checkpoint " << conf.checkpoint_fname
+        << " at round " << cp.next_round);
+    prev_measure = cp.prev_measure;
+    num_hash_list = cp.num_hash_list;
+    num_count_list = cp.num_count_list;
+    std::istringstream(cp.rnd_engine) >> rnd_engine;
+    for (const auto& m: cp.models) {
+        vector<lbool> model(solver->nVars(), l_Undef);
+        for (uint32_t i = 0; i < m.size() && i < model.size(); i++) {
+            if (m[i] == '1') model[i] = l_True;
+            else if (m[i] == '0') model[i] = l_False;
+        }
+        hm.glob_model.emplace_back(SavedModel(model, 0));
+    }
+    cert_round_pos.assign(cp.cert_round_pos.begin(), cp.cert_round_pos.end());
+    cert_m0 = cp.cert_m0;
+}
+
+void Counter::write_round_checkpoint(
+    const uint32_t next_round, const int64_t prev_measure, const HashesModels& hm)
+{
+    Checkpoint cp;
+    cp.key = checkpoint_key();
+    cp.next_round = next_round;
+    cp.prev_measure = prev_measure;
+    cp.num_hash_list = num_hash_list;
+    cp.num_count_list = num_count_list;
+    std::stringstream rnd;
+    rnd << rnd_engine;
+    cp.rnd_engine = rnd.str();
+    for (const auto& sm: hm.glob_model) {
+        assert(sm.hash_num == 0);
+        string m(orig_num_vars, 'u');
+        for (uint32_t i = 0; i < orig_num_vars && i < sm.model.size(); i++) {
+            if (sm.model[i] == l_True) m[i] = '1';
+            else if (sm.model[i] == l_False) m[i] = '0';
+        }
+        cp.models.push_back(m);
+    }
+    if (certfile.is_open()) cp.cert_size = certfile.tellp();
+    cp.cert_round_pos.assign(cert_round_pos.begin(), cert_round_pos.end());
+    cp.cert_m0 = cert_m0;
+
+    if (write_checkpoint(conf.checkpoint_fname, cp)) {
+        verb_print(1, "[appmc] Wrote checkpoint " << conf.checkpoint_fname
+            << " before round " << next_round);
+    } else {
+        cout << "c [appmc] WARNING: could not write checkpoint " << conf.checkpoint_fname << endl;
+    }
+}
+
+// Writes the solutions recorded for the cell at 'hash_cnt' in this round,
+// 'printed' is set to their number. Returns false if one could not be extended.
+bool Counter::print_models(std::ostream& out, const HashesModels& hm, uint64_t hash_cnt,
+    uint32_t& printed)
+{
+    printed = 0;
+    const auto it = hm.cells.find(hash_cnt);
+    if (it == hm.cells.end()) return true;
+
+    vector<lbool> full;
+    for (const uint32_t at: it->second) {
+        if (!extend_model(hm.glob_model[at].model, full)) return false;
+        print_cert_model(out, full);
+        printed++;
+    }
+    return true;
+}
+
+// Models are enumerated without extending them past the sampling set. Only
+// the ones that go into the certificate are extended, by solving again with
+// the projected part of the model as assumptions
+bool Counter::extend_model(const vector<lbool>& model, vector<lbool>& full)
+{
+    if (conf.force_sol_extension) {
+        full = model;
+        return true;
+    }
+
+    vector<Lit> assumps = user_assumps;
+    for (const uint32_t var: conf.sampl_vars) {
+        assert(model[var] != l_Undef);
+        assumps.push_back(Lit(var, model[var] == l_False));
+    }
+    TraceSpan span("extend_model");
+    // The round is done, so interrupts are ignored here: interrupt_flag stays
+    // set and stops the count after this round. The solver clears its own
+    // interrupt when it starts solving again, so it is asked again.
+    lbool ret = l_Undef;
+    for (uint32_t tries = 0; ret == l_Undef && tries < 3; tries++) {
+        ret = solver->solve(&assumps, false);
+        stats.sat_calls++;
+        if (ret == l_Undef && !interrupt_flag) break;
+    }
+    if (ret != l_True) {
+        cout << "[appmc] ERROR: could not extend a model to a full solution,"
+        " the count stops before this round" << endl;
+        return false;
+    }
+    full = solver->get_model();
+    return true;
+}
+
+// Compact certificate line: only the variables set to true are listed, the
+// checker takes every variable that is not listed to be false
+void Counter::print_cert_model(std::ostream& out, const vector<lbool>& model)
+{
+    for (uint32_t var = 0; var < orig_num_vars; var++) {
+        if (model[var] == l_True) out << Lit(var, false) << ' ';
+    }
+    out << '0' << '\n';
 }
 
 ApproxMC::SolCount Counter::calc_est_count()
@@ -530,10 +1057,12 @@ ApproxMC::SolCount Counter::calc_est_count()
     ApproxMC::SolCount ret_count;
     if (num_hash_list.empty() || num_count_list.empty()) return ret_count;
 
+    // A copy, it is also called for the progress of the count
+    vector<int64_t> counts = num_count_list;
     const auto min_hash = find_min(num_hash_list);
-    auto cnt_it = num_count_list.begin();
+    auto cnt_it = counts.begin();
     for (auto hash_it = num_hash_list.begin()
-        ; hash_it != num_hash_list.end() && cnt_it != num_count_list.end()
+        ; hash_it != num_hash_list.end() && cnt_it != counts.end()
         ; hash_it++, cnt_it++
     ) {
         if ((*hash_it) - min_hash > 10) {
@@ -544,7 +1073,7 @@ ApproxMC::SolCount Counter::calc_est_count()
         *cnt_it *= pow(2, (*hash_it) - min_hash);
     }
     ret_count.valid = true;
-    ret_count.cellSolCount = find_median(num_count_list);
+    ret_count.cellSolCount = find_median(counts);
     ret_count.hashCount = min_hash;
 
     return ret_count;
@@ -608,6 +1137,12 @@ void Counter::one_measurement_count(
 
     base_rand = iter * (conf.sampl_vars.size()-1) * (conf.sampl_vars.size()+1);
 
+    // A warm round starts from the hash count of the last count, with its
+    // hashes. Clauses were only added, so the answer is at most that, and
+    // the search gallops down from it.
+    const bool warm = warm_start && iter < incr.hash_counts.size();
+    int64_t warm_step = 1;
+
     //We are doing a galloping search here (see our IJCAI-16 paper for more details).
     //lowerFib is referred to as loIndex and upperFib is referred to as hiIndex
     //The key idea is that we first do an exponential search and then do binary search
@@ -619,10 +1154,9 @@ void Counter::one_measurement_count(
         const vector<Lit> assumps = set_num_hashes(hash_cnt, hm->hashes, sparse_data);
 
         verb_print(1, "[appmc] "
-            "[ " << std::setw(7) << std::setprecision(2) << std::fixed << (cpuTimeTotal()-start_time) << " ]"
+            "[ " << std::setw(7) << std::setprecision(2) << std::fixed << (wallTime()-start_time) << " ]"
             << " round: " << std::setw(2) << iter
             << " hashes: " << std::setw(6) << hash_cnt);
-        double my_time = cpuTime();
         SolNum sols = bounded_sol_count(
             threshold + 1, //max no. solutions
             &assumps, //assumptions to use
@@ -630,14 +1164,9 @@ void Counter::one_measurement_count(
             iter,
             hm
         );
+        if (stopped_early) return;
         const uint64_t num_sols = std::min<uint64_t>(sols.solutions, threshold + 1);
         assert(num_sols <= threshold + 1);
-        bool found_full = (num_sols == threshold + 1);
-        write_log(
-            false, //not sampling
-            iter, hash_cnt, found_full, num_sols, sols.repeated,
-            cpuTime() - my_time
-        );
 
         if (num_sols < threshold + 1) {
             num_explored = lower_fib + total_max_xors - hash_cnt;
@@ -657,7 +1186,15 @@ void Counter::one_measurement_count(
 
             threshold_sols[hash_cnt] = 0;
             sols_for_hash[hash_cnt] = num_sols;
-            if (iter > 0 &&
+            if (warm) {
+                upper_fib = hash_cnt;
+                if (threshold_sols.count(lower_fib) && threshold_sols[lower_fib]) {
+                    hash_cnt = (upper_fib+lower_fib)/2;
+                } else {
+                    hash_cnt = std::max<int64_t>(0, hash_cnt-warm_step);
+                    warm_step *= 2;
+                }
+            } else if ((iter > 0 || warm_start) &&
                 std::abs(hash_cnt - prev_measure) <= 2
             ) {
                 //Doing linear, this is a re-count
@@ -687,7 +1224,11 @@ void Counter::one_measurement_count(
 
             threshold_sols[hash_cnt] = 1;
             sols_for_hash[hash_cnt] = threshold+1;
-            if (iter > 0
+            if (warm && threshold_sols.count(upper_fib) && !threshold_sols[upper_fib]) {
+                // Galloped down past the answer, it is in between
+                lower_fib = hash_cnt;
+                hash_cnt = (lower_fib+upper_fib)/2;
+            } else if ((iter > 0 || warm_start)
                 && std::abs(hash_cnt - prev_measure) < 2
             ) {
                 //Doing linear, this is a re-count
@@ -805,27 +1346,21 @@ string Counter::get_version_info() const
     return ret;
 }
 
-void Counter::open_logfile()
+// A resumed count appends to the log of the run it goes on from
+void Counter::open_logfile(const bool resumed)
 {
-    if (!conf.logfilename.empty()) {
-        logfile.open(conf.logfilename.c_str());
-        if (!logfile.is_open()) {
+    if (conf.log_fd >= 0) {
+        if (!events.open_fd(conf.log_fd)) {
+            cout << "[appmc] Cannot open Counter log fd " << conf.log_fd
+                 << " for writing." << endl;
+            exit(1);
+        }
+    } else if (!conf.logfilename.empty()) {
+        if (!events.open_file(conf.logfilename, resumed)) {
             cout << "[appmc] Cannot open Counter log file '" << conf.logfilename
                  << "' for writing." << endl;
             exit(1);
         }
-
-        logfile << std::left
-        << std::setw(5) << "sampl"
-        << " " << std::setw(4) << "iter"
-        << " " << std::setw(4) << "hash"
-        << " " << std::setw(4) << "full"
-        << " " << std::setw(4) << "sols"
-        << " " << std::setw(4) << "rep"
-        << " " << std::setw(7) << "T"
-        << " " << std::setw(7) << "total T"
-        << endl;
-
     }
 }
 
@@ -841,10 +1376,17 @@ void Counter::open_randfile()
     }
 }
 
-void Counter::open_certfile()
+// When resuming, the certificate was cut back to the checkpoint and is
+// written on at its end
+void Counter::open_certfile(const bool resumed)
 {
     if (!conf.certfilename.empty()) {
-        certfile.open(conf.certfilename.c_str());
+        if (resumed) {
+            certfile.open(conf.certfilename.c_str(), ios::in | ios::out | ios::binary);
+            certfile.seekp(0, ios::end);
+        } else {
+            certfile.open(conf.certfilename.c_str());
+        }
         if (!certfile.is_open()) {
             cout << "[appmc] Cannot open Counter certification file '" << conf.certfilename
                  << "' for writing." << endl;
@@ -853,28 +1395,22 @@ void Counter::open_certfile()
     }
 }
 
-void Counter::write_log(
-    bool sampling,
-    int iter,
-    uint32_t hash_cnt,
-    int found_full,
-    uint32_t num_sols,
-    uint32_t repeat_sols,
-    double used_time
-) {
-    if (!conf.logfilename.empty()) {
-        logfile
-        << std::left
-        << std::setw(5) << (int)sampling
-        << " " << std::setw(4) << iter
-        << " " << std::setw(4) << hash_cnt
-        << " " << std::setw(4) << found_full
-        << " " << std::setw(4) << num_sols
-        << " " << std::setw(4) << repeat_sols
-        << " " << std::setw(7) << std::fixed << std::setprecision(2) << used_time
-        << " " << std::setw(7) << std::fixed << std::setprecision(2) << (cpuTimeTotal() - start_time)
-        << endl;
+// A shard is a complete single-round certificate: the header tells which
+// round it is, then comes the cell at 0 hashes, then the round itself
+void Counter::open_cert_shard(const uint32_t iter, const int64_t hash_cnt)
+{
+    const string fname = conf.certfilename + "." + std::to_string(iter);
+    certfile.open(fname.c_str());
+    if (!certfile.is_open()) {
+        cout << "[appmc] Cannot open Counter certification shard '" << fname
+             << "' for writing." << endl;
+        exit(1);
     }
+    certfile
+    << "c approxmc certificate shard" << '\n'
+    << "c round " << iter << '\n'
+    << "c hashes " << hash_cnt << '\n'
+    << cert_m0;
 }
 
 void Counter::check_model(
@@ -34,8 +34,13 @@
 #include <utility>
 #include <cstdint>
 #include <mutex>
+#include <atomic>
 #include "approxmc.h"
 #include "appmc_constants.h"
+#include "checkpoint.h"
+#include "time_mem.h"
+#include "eventlog.h"
+#include "trace.h"
 
 using std::string;
 using std::vector;
@@ -67,8 +72,13 @@ struct HashesModels {
     map<uint64_t, Hash> hashes;
     vector<SavedModel> glob_model; //global table storing models
 
+    //Solutions of the cell at a given hash count, as indices into glob_model.
+    //Only filled when certifying, reset every round like the hashes
+    map<uint64_t, vector<uint32_t>> cells;
+
     void clear() {
         hashes.clear();
+        cells.clear();
         vector<SavedModel> clean_glob_model;
         for(auto const& m: glob_model) {
             if (m.hash_num == 0) clean_glob_model.push_back(m);
@@ -77,6 +87,18 @@ struct HashesModels {
     }
 };
 
+// The rounds of the last count, a recount after clauses were added starts
+// from them
+struct IncrementalState {
+    bool valid = false;
+    string key; //sampling set, assumptions and options of the count
+    vector<int64_t> hash_counts;
+    vector<map<uint64_t, Hash>> hashes;
+    vector<vector<SavedModel>> models;
+    vector<vector<Lit>> new_cls; //added since the count
+    vector<pair<vector<Lit>, bool>> new_xors;
+};
+
 struct SolNum {
     SolNum (uint64_t _solutions, uint64_t _repeated):
         solutions(_solutions), repeated(_repeated) {}
@@ -95,7 +117,8 @@ struct SparseData {
 class Counter {
 public:
     Counter(Config& _conf) : conf(_conf) {}
-    ApproxMC::SolCount solve();
+    ApproxMC::SolCount solve(const vector<Lit>& assumps);
+    void reset();
     string gen_rnd_bits(const uint32_t size,
                         const uint32_t numhashes, SparseData& sparse_data);
     string binary(const uint32_t x, const uint32_t length);
@@ -105,14 +128,28 @@ public:
     SATSolver* solver = nullptr;
     string get_version_info() const;
     ApproxMC::SolCount calc_est_count();
-    const Constants constants;
+    const Constants& constants = Constants::get();
     bool solver_add_clause(const vector<Lit>& cl);
+    bool solver_add_clause(const Lit* begin, const Lit* end); //also digested
+    bool solver_add_dimacs_clause(const int32_t* begin, const int32_t* end); //also digested
     bool solver_add_xor_clause(const vector<uint32_t>& vars, const bool rhs);
     bool solver_add_xor_clause(const vector<Lit>& lits, const bool rhs);
 
+    //Stop the SAT call that runs, safe to call from a signal handler
+    void interrupt_asap() {
+        interrupt_flag = true;
+        if (solver) solver->interrupt_asap();
+    }
+    ApproxMC::ProgressCallback progress;
+    void digest_input(const uint32_t kind, const vector<Lit>& lits);
+    bool stopped_early = false; //count is the median of the rounds done so far
+    uint32_t rounds_done = 0;
+    double effective_delta = 0;
+    ApproxMC::CountStats stats;
+
 private:
     Config& conf;
-    ApproxMC::SolCount count();
+    ApproxMC::SolCount count(const Checkpoint* resume_from);
     void add_appmc_options();
     Hash add_hash(uint32_t total_num_hashes, SparseData& sparse_data);
     SolNum bounded_sol_count(
@@ -140,19 +177,31 @@ private:
         SparseData sparse_data,
         HashesModels* hm
     );
-    void write_log(
-        bool sampling,
-        int iter,
-        uint32_t hash_count,
-        int found_full,
-        uint32_t num_sols,
-        uint32_t repeat_sols,
-        double used_time
-    );
-    void open_logfile();
+    void open_logfile(const bool resumed);
     void open_randfile();
-    void open_certfile();
+    void open_certfile(const bool resumed);
+    void open_cert_shard(const uint32_t iter, const int64_t hash_cnt);
+    bool write_cert_round(const HashesModels& hm, const uint32_t iter, const int64_t measure);
     void call_after_parse();
+    bool must_stop();
+    void stop_early(uint32_t rounds);
+    struct SolverCounters {
+        uint64_t conflicts = 0;
+        uint64_t propagations = 0;
+        uint64_t decisions = 0;
+    };
+    SolverCounters get_solver_counters();
+    SolverCounters read_solver_counters();
+    void fill_stats(const SolverCounters& start, const double start_cpu);
+    void add_solver_counters(const SolverCounters& start);
+    string checkpoint_key();
+    string incremental_key();
+    void warm_start_round(const uint32_t iter, int64_t& prev_measure, HashesModels& hm);
+    bool model_survives(const vector<lbool>& model, const vector<char>& in_sampl) const;
+    bool read_resume_checkpoint(Checkpoint& cp);
+    void resume_from_checkpoint(const Checkpoint& cp, int64_t& prev_measure, HashesModels& hm);
+    void write_round_checkpoint(const uint32_t next_round, const int64_t prev_measure,
+        const HashesModels& hm);
     void ban_one(const uint32_t act_var, const vector<lbool>& model);
     void check_model(
         const vector<lbool>& model,
@@ -164,8 +213,12 @@ private:
         const HashesModels* glob_model = nullptr
         , const uint32_t act_var = std::numeric_limits<uint32_t>::max()
         , const uint32_t num_hashes = std::numeric_limits<uint32_t>::max()
+        , vector<uint32_t>* banned = nullptr
     );
-    int print_models(HashesModels hm, int64_t hashCount);
+    bool print_models(std::ostream& out, const HashesModels& hm, uint64_t hash_cnt,
+        uint32_t& printed);
+    bool extend_model(const vector<lbool>& model, vector<lbool>& full);
+    void print_cert_model(std::ostream& out, const vector<lbool>& model);
 
     void read_in_a_file(SATSolver* solver2, const string& filename);
     void read_stdin(SATSolver* solver2);
@@ -181,10 +234,20 @@ private:
     ////////////////
     // internal data
     ////////////////
-    double start_time;
-    std::ofstream logfile;
+    double start_time; //wall-clock
+    PhaseTimes phases;
+    EventLog events;
     std::ifstream randfile;
     std::ofstream certfile;
+    string cert_m0; //cell at 0 hashes, every shard starts with it
+    vector<std::streampos> cert_round_pos; //where each round starts in certfile
+    std::atomic<bool> interrupt_flag{false};
+    vector<Lit> user_assumps; //every SAT call of the count is under these
+    vector<Lit> tmp_cl; //of the bulk adds, reused
+    uint32_t own_vars = 0; //hash and banning variables of earlier counts
+    Digest input_digest; //of the formula, the key of the checkpoint
+    IncrementalState incr;
+    bool warm_start = false; //rounds start from those of incr
     std::mt19937 rnd_engine;
     uint32_t orig_num_vars;
     double total_inter_simp_time = 0;
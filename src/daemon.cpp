@@ -0,0 +1,432 @@
+/*
+ ApproxMC
+
+ Copyright (c) 2019-2020, Mate Soos and Kuldeep S. Meel. All rights reserved
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#include "daemon.h"
+#include "approxmc.h"
+#include "time_mem.h"
+#include "trace.h"
+
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <cstring>
+#include <cstdlib>
+
+#if !defined(_WIN32) && !defined(__EMSCRIPTEN__)
+#include <unistd.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#define APPMC_DAEMON
+#endif
+
+using std::string;
+using std::vector;
+using std::cout;
+using std::endl;
+using namespace CMSat;
+
+namespace AppMCInt {
+
+#ifndef APPMC_DAEMON
+int run_daemon(const DaemonConf&)
+{
+    cout << "ERROR: daemon mode is not supported on this platform" << endl;
+    return -1;
+}
+#else
+
+// Largest frame accepted, a longer one closes the connection
+static const uint32_t max_frame = 1U << 30;
+
+static std::atomic<bool> daemon_stop(false);
+
+static void daemon_signal(int)
+{
+    daemon_stop = true;
+}
+
+// The socket is closed when the reader and all replies in flight are done
+struct DaemonConn {
+    explicit DaemonConn(int _fd) : fd(_fd) {}
+    ~DaemonConn() {close(fd);}
+    const int fd;
+    std::mutex write_mutex;
+
+    bool send_frame(const string& msg) {
+        std::lock_guard<std::mutex> lock(write_mutex);
+        const uint32_t len = msg.size();
+        const unsigned char hdr[4] = {
+            (unsigned char)(len >> 24), (unsigned char)(len >> 16),
+            (unsigned char)(len >> 8), (unsigned char)len};
+        return send_all((const char*)hdr, 4) && send_all(msg.data(), msg.size());
+    }
+
+    bool read_frame(string& msg) {
+        unsigned char hdr[4];
+        if (!recv_all((char*)hdr, 4)) return false;
+        const uint32_t len = ((uint32_t)hdr[0] << 24) | ((uint32_t)hdr[1] << 16)
+            | ((uint32_t)hdr[2] << 8) | hdr[3];
+        if (len > max_frame) return false;
+        msg.resize(len);
+        return recv_all(&msg[0], len);
+    }
+
+private:
+    bool send_all(const char* data, size_t len) {
+        while (len) {
+            const ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            data += n;
+            len -= n;
+        }
+        return true;
+    }
+    bool recv_all(char* data, size_t len) {
+        while (len) {
+            const ssize_t n = recv(fd, data, len, 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            data += n;
+            len -= n;
+        }
+        return true;
+    }
+};
+
+struct DaemonJob {
+    std::shared_ptr<DaemonConn> conn;
+    string id;
+    string request;
+};
+
+// The count a worker runs, so that stopping the daemon can interrupt it
+struct DaemonWorker {
+    std::mutex mutex;
+    ApproxMC::AppMC* active = nullptr;
+};
+
+struct DaemonRequest {
+    double epsilon;
+    double delta;
+    uint32_t seed;
+    double max_time;
+    bool ind_given = false;
+    vector<uint32_t> ind;
+    uint32_t nvars = 0;
+    vector<vector<Lit>> cls;
+    vector<std::pair<vector<uint32_t>, bool>> xors;
+};
+
+// Returns an error message, empty if the request is fine
+static string parse_request(const string& text, DaemonRequest& req, const DaemonConf& conf)
+{
+    std::istringstream in(text);
+    string line;
+    bool header = false;
+    uint64_t lineno = 0;
+    while (std::getline(in, line)) {
+        lineno++;
+        std::istringstream ls(line);
+        string key;
+        if (!(ls >> key)) continue;
+        const string at = " at line " + std::to_string(lineno);
+        if (key[0] == 'c') continue;
+        if (!header) {
+            if (key == "id") continue;
+            if (key == "epsilon") {if (!(ls >> req.epsilon) || req.epsilon <= 0) return "invalid epsilon" + at; continue;}
+            if (key == "delta") {if (!(ls >> req.delta) || req.delta <= 0 || req.delta >= 1) return "invalid delta" + at; continue;}
+            if (key == "seed") {if (!(ls >> req.seed)) return "invalid seed" + at; continue;}
+            if (key == "maxtime") {
+                double t;
+                if (!(ls >> t) || t <= 0) return "invalid maxtime" + at;
+                if (req.max_time == 0 || t < req.max_time) req.max_time = t;
+                continue;
+            }
+            if (key == "ind") {
+                int64_t v;
+                bool terminated = false;
+                req.ind_given = true;
+                while (ls >> v) {
+                    if (v == 0) {terminated = true; break;}
+                    if (v < 0) return "invalid sampling var" + at;
+                    req.ind.push_back(v-1);
+                }
+                if (!terminated) return "sampling set not terminated with 0" + at;
+                continue;
+            }
+            if (key == "p") {
+                string cnf;
+                int64_t nvars, ncls;
+                if (!(ls >> cnf >> nvars >> ncls) || cnf != "cnf" || nvars < 0 || ncls < 0) return "invalid header" + at;
+                if ((uint64_t)nvars > conf.max_vars) {
+                    return "too many variables, at most " + std::to_string(conf.max_vars) + at;
+                }
+                if ((uint64_t)ncls > conf.max_clauses) {
+                    return "too many clauses, at most " + std::to_string(conf.max_clauses) + at;
+                }
+                req.nvars = nvars;
+                header = true;
+                continue;
+            }
+            return "unknown request line '" + key + "'" + at;
+        }
+        // The header may claim fewer than there are
+        if (req.cls.size() + req.xors.size() >= conf.max_clauses) {
+            return "too many clauses, at most " + std::to_string(conf.max_clauses) + at;
+        }
+        const bool is_xor = key[0] == 'x';
+        std::istringstream lits(is_xor ? line.substr(line.find('x')+1) : line);
+        vector<Lit> cl;
+        int64_t l;
+        bool terminated = false;
+        while (lits >> l) {
+            if (l == 0) {terminated = true; break;}
+            if ((uint64_t)std::abs(l) > req.nvars) return "invalid literal" + at;
+            cl.push_back(Lit(std::abs(l)-1, l < 0));
+        }
+        if (!terminated) return "line not terminated with 0" + at;
+        if (is_xor) {
+            vector<uint32_t> vars;
+            bool rhs = true;
+            for (const Lit lit: cl) {vars.push_back(lit.var()); rhs ^= lit.sign();}
+            req.xors.push_back(std::make_pair(vars, rhs));
+        } else {
+            req.cls.push_back(cl);
+        }
+    }
+    if (!header) return "missing DIMACS header";
+    for (const uint32_t v: req.ind) if (v >= req.nvars) return "sampling var out of range";
+    return string();
+}
+
+static string request_id(const string& text)
+{
+    std::istringstream in(text);
+    string line;
+    while (std::getline(in, line)) {
+        std::istringstream ls(line);
+        string key, id;
+        ls >> key;
+        if (key == "id") {ls >> id; return id;}
+        if (key == "p") break;
+    }
+    return string();
+}
+
+static string run_job(const DaemonJob& job, const DaemonConf& conf,
+    ApproxMC::AppMCPool& pool, DaemonWorker& worker)
+{
+    const double start_time = wallTime();
+    TraceSpan span("request");
+    DaemonRequest req;
+    req.epsilon = conf.epsilon;
+    req.delta = conf.delta;
+    req.seed = conf.seed;
+    req.max_time = conf.max_time;
+    const string err = parse_request(job.request, req, conf);
+    std::stringstream out;
+    out << "id " << job.id << '\n';
+    if (!err.empty()) {
+        out << "status error" << '\n' << "message " << err << '\n';
+        return out.str();
+    }
+
+    ApproxMC::AppMCPool::Handle appmc = pool.acquire();
+    appmc->set_verbosity(0);
+    appmc->set_epsilon(req.epsilon);
+    appmc->set_delta(req.delta);
+    appmc->set_seed(req.seed);
+    appmc->set_max_time(req.max_time);
+    appmc->new_vars(req.nvars);
+    for (const auto& cl: req.cls) appmc->add_clause(cl);
+    for (const auto& x: req.xors) appmc->add_xor_clause(x.first, x.second);
+    if (!req.ind_given) {
+        req.ind.clear();
+        for (uint32_t i = 0; i < req.nvars; i++) req.ind.push_back(i);
+    }
+    appmc->set_sampl_vars(req.ind);
+    {
+        // Checked after it is set, the daemon may be stopping already
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        worker.active = appmc.get();
+        if (daemon_stop) appmc->interrupt_asap();
+    }
+    const ApproxMC::SolCount c = appmc->count();
+    {
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        worker.active = nullptr;
+    }
+    if (!c.valid) {
+        out << "status error" << '\n' << "message stopped before a round was done" << '\n';
+        return out.str();
+    }
+
+    mpz_class num_sols(2);
+    mpz_pow_ui(num_sols.get_mpz_t(), num_sols.get_mpz_t(), c.hashCount);
+    num_sols *= c.cellSolCount;
+    out << "status ok" << '\n'
+    << "mc " << num_sols << '\n'
+    << "cellsolcount " << c.cellSolCount << '\n'
+    << "hashcount " << c.hashCount << '\n'
+    << "time " << (wallTime() - start_time) << '\n';
+    if (appmc->get_stopped_early()) {
+        out << "stoppedearly 1" << '\n'
+        << "effectivedelta " << appmc->get_effective_delta() << '\n';
+    }
+    return out.str();
+}
+
+// Shared with the connection readers, which may outlive run_daemon()
+class DaemonQueue {
+public:
+    explicit DaemonQueue(uint32_t _max_queued) : max_queued(_max_queued) {}
+
+    // Refuses the job if too many are waiting already
+    bool push(DaemonJob&& job) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (stopped || jobs.size() >= max_queued) return false;
+        jobs.push_back(std::move(job));
+        cond.notify_one();
+        return true;
+    }
+    bool pop(DaemonJob& job) {
+        std::unique_lock<std::mutex> lock(mutex);
+        cond.wait(lock, [&]() {return stopped || !jobs.empty();});
+        if (jobs.empty()) return false;
+        job = std::move(jobs.front());
+        jobs.pop_front();
+        return true;
+    }
+    void stop() {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopped = true;
+        cond.notify_all();
+    }
+
+private:
+    const uint32_t max_queued;
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::deque<DaemonJob> jobs;
+    bool stopped = false;
+};
+
+int run_daemon(const DaemonConf& conf)
+{
+    const int lfd = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (conf.socket_path.size() >= sizeof(addr.sun_path)) {
+        cout << "ERROR: socket path '" << conf.socket_path << "' is too long" << endl;
+        return -1;
+    }
+    strcpy(addr.sun_path, conf.socket_path.c_str());
+    unlink(conf.socket_path.c_str());
+    if (lfd < 0
+        || bind(lfd, (struct sockaddr*)&addr, sizeof(addr)) != 0
+        || listen(lfd, 128) != 0)
+    {
+        cout << "ERROR: could not listen on socket '" << conf.socket_path
+        << "': " << strerror(errno) << endl;
+        return -1;
+    }
+    signal(SIGINT, daemon_signal);
+    signal(SIGTERM, daemon_signal);
+    signal(SIGPIPE, SIG_IGN);
+    if (conf.verb) {
+        cout << "c [daemon] listening on " << conf.socket_path
+        << " workers: " << conf.workers << " max queued: " << conf.max_queued << endl;
+    }
+
+    auto queue = std::make_shared<DaemonQueue>(conf.max_queued);
+    auto num_requests = std::make_shared<std::atomic<uint64_t>>(0);
+    auto num_refused = std::make_shared<std::atomic<uint64_t>>(0);
+    // One instance per worker, they are reset between requests
+    ApproxMC::AppMCPool pool(std::max<uint32_t>(conf.workers, 1));
+    vector<DaemonWorker> worker_state(std::max<uint32_t>(conf.workers, 1));
+    vector<std::thread> workers;
+    for (uint32_t i = 0; i < worker_state.size(); i++) {
+        workers.emplace_back([&, i]() {
+            trace_thread_name("worker " + std::to_string(i));
+            DaemonJob job;
+            while (queue->pop(job)) {
+                job.conn->send_frame(run_job(job, conf, pool, worker_state[i]));
+                job = DaemonJob();
+            }
+        });
+    }
+
+    while (!daemon_stop) {
+        struct pollfd pfd = {lfd, POLLIN, 0};
+        if (poll(&pfd, 1, 200) <= 0) continue;
+        const int fd = accept(lfd, nullptr, nullptr);
+        if (fd < 0) continue;
+        auto conn = std::make_shared<DaemonConn>(fd);
+        // One reader per connection, it only parses frames and queues them
+        std::thread([conn, queue, num_requests, num_refused]() {
+            string msg;
+            while (conn->read_frame(msg)) {
+                (*num_requests)++;
+                DaemonJob job{conn, request_id(msg), string()};
+                const string id = job.id;
+                job.request = std::move(msg);
+                if (!queue->push(std::move(job))) {
+                    (*num_refused)++;
+                    conn->send_frame("id " + id + "\nstatus busy\nmessage queue is full\n");
+                }
+                msg.clear();
+            }
+        }).detach();
+    }
+
+    if (conf.verb) {
+        cout << "c [daemon] stopping, requests: " << *num_requests
+        << " refused: " << *num_refused << endl;
+    }
+    close(lfd);
+    unlink(conf.socket_path.c_str());
+    queue->stop();
+    // Queued counts see daemon_stop and stop at once
+    for (auto& w: worker_state) {
+        std::lock_guard<std::mutex> lock(w.mutex);
+        if (w.active) w.active->interrupt_asap();
+    }
+    for (auto& th: workers) th.join();
+    return 0;
+}
+#endif
+
+}
@@ -0,0 +1,77 @@
+/*
+ ApproxMC
+
+ Copyright (c) 2019-2020, Mate Soos and Kuldeep S. Meel. All rights reserved
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <string>
+#include <cstdint>
+
+namespace AppMCInt {
+
+struct DaemonConf {
+    std::string socket_path;
+    uint32_t workers = 1;
+    uint32_t max_queued = 64; // requests waiting for a worker, more are refused
+    // Larger formulas get an error reply, they would take the memory of the
+    // whole daemon
+    uint32_t max_vars = 1U << 22;
+    uint64_t max_clauses = 1ULL << 24; // clauses and XORs
+    double max_time = 0; // wall-clock seconds of a count, 0 = no limit
+    uint32_t verb = 1;
+
+    // Used by requests that do not give them
+    double epsilon = 0.8;
+    double delta = 0.2;
+    uint32_t seed = 1;
+};
+
+// Serves count requests on a Unix domain socket until SIGINT or SIGTERM.
+//
+// Every message, in both directions, is a frame: a 4-byte big-endian length
+// followed by that many bytes of text. A request is a set of header lines
+// and a CNF-XOR formula in DIMACS:
+//
+//   id q1              -- optional, echoed in the reply
+//   epsilon 0.8        -- optional
+//   delta 0.2          -- optional
+//   seed 1             -- optional
+//   maxtime 60         -- optional, seconds, at most max_time if that is set
+//   ind 1 2 3 0        -- optional sampling set, default: all variables
+//   p cnf 3 2
+//   1 2 0
+//   x1 3 0
+//
+// The formula may have at most max_vars variables and max_clauses clauses
+// and XORs. The reply is sent when the count is done, replies to requests on the same
+// connection can come in any order. It has lines 'id', 'status' (ok, busy or
+// error) and, if ok, 'mc', 'cellsolcount', 'hashcount' and 'time', or, if
+// not, 'message'. A count stopped by its time limit or by the daemon
+// stopping is the median of the rounds done, the reply then also has
+// 'stoppedearly 1' and the 'effectivedelta' of that count. If no round was
+// done, the status is error.
+//
+// SIGINT or SIGTERM stop the counts that are running or queued.
+int run_daemon(const DaemonConf& conf);
+
+}
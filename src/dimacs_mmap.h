@@ -0,0 +1,352 @@
+/*
+ ApproxMC
+
+ Copyright (c) 2019-2020, Mate Soos and Kuldeep S. Meel. All rights reserved
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+// Parser for plain DIMACS CNF-XOR files that maps the file into memory, cuts
+// it into chunks at line ends and tokenises the chunks in parallel. The
+// constraints are then handed to the reader in file order, the same way
+// CryptoMiniSat's DimacsParser does.
+//
+// It only reads well-formed files with a 'p cnf' header, clauses, 'x' lines
+// and 'c ind' lines. Anything else, e.g. a gzipped file, a 'c p ...' line or
+// a malformed line, is left to DimacsParser, which then also reports the
+// error. The decision is taken before anything is added to the reader.
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <limits>
+#include <cryptominisat5/solvertypesmini.h>
+#include "time_mem.h"
+#include "trace.h"
+
+#if !defined(_WIN32) && !defined(__EMSCRIPTEN__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define APPMC_MMAP_PARSER
+#endif
+
+namespace AppMCInt {
+
+struct DimacsItem {
+    enum Kind : uint8_t {header, clause, xor_clause, ind};
+    Kind kind;
+    size_t start; // literals are lits[start..start of next item)
+};
+
+struct DimacsChunk {
+    std::vector<int32_t> lits;
+    std::vector<DimacsItem> items;
+    int32_t max_var = 0;
+    uint64_t num_cls = 0;
+    uint64_t num_xors = 0;
+    bool ok = true;        // false: leave the file to DimacsParser
+    bool open_end = false; // the chunk ends inside a clause
+};
+
+class DimacsChunkParser {
+public:
+    DimacsChunkParser(const char* _p, const char* _e, DimacsChunk& _ch) :
+        p(_p), e(_e), ch(_ch) {}
+
+    void parse() {
+        while (ch.ok) {
+            skip_space();
+            if (p == e) return;
+            switch (*p) {
+                case 'p':
+                    p++;
+                    parse_header();
+                    break;
+                case 'c':
+                    p++;
+                    parse_comment();
+                    break;
+                case 'x':
+                    p++;
+                    parse_lits(DimacsItem::xor_clause);
+                    break;
+                default:
+                    parse_lits(DimacsItem::clause);
+            }
+        }
+    }
+
+private:
+    const char* p;
+    const char* e;
+    DimacsChunk& ch;
+
+    // Like DimacsParser, clauses may span lines
+    void skip_space() {
+        while (p < e && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) p++;
+    }
+    void skip_blanks() {
+        while (p < e && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+    }
+    void skip_line() {
+        while (p < e && *p != '\n') p++;
+    }
+    bool at_eol() {
+        skip_blanks();
+        return p == e || *p == '\n';
+    }
+    std::string word() {
+        skip_blanks();
+        const char* from = p;
+        while (p < e && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n') p++;
+        return std::string(from, p-from);
+    }
+    bool get_int(int64_t& val, bool cross_lines) {
+        if (cross_lines) skip_space();
+        else skip_blanks();
+        bool neg = false;
+        if (p < e && (*p == '-' || *p == '+')) neg = *p++ == '-';
+        if (p == e || *p < '0' || *p > '9') return false;
+        val = 0;
+        while (p < e && *p >= '0' && *p <= '9') {
+            val = val*10 + (*p++ - '0');
+            if (val > std::numeric_limits<int32_t>::max()) return false;
+        }
+        if (neg) val = -val;
+        return true;
+    }
+
+    void parse_header() {
+        int64_t nvars, ncls;
+        if (word() != "cnf" || !get_int(nvars, false) || !get_int(ncls, false)
+            || nvars < 0 || ncls < 0 || !at_eol())
+        {
+            ch.ok = false;
+            return;
+        }
+        ch.items.push_back(DimacsItem{DimacsItem::header, ch.lits.size()});
+        ch.lits.push_back(nvars);
+        ch.lits.push_back(ncls);
+    }
+
+    void parse_comment() {
+        if (at_eol()) return;
+        const std::string w = word();
+        if (w == "ind") {
+            const size_t start = ch.lits.size();
+            int64_t v;
+            while (true) {
+                if (!get_int(v, false) || v < 0) {ch.ok = false; return;}
+                if (v == 0) break;
+                ch.lits.push_back(v);
+                ch.max_var = std::max<int32_t>(ch.max_var, v);
+            }
+            ch.items.push_back(DimacsItem{DimacsItem::ind, start});
+        } else if (w == "p" || w == "MUST") {
+            // Projection, weights and multipliers are DimacsParser's
+            ch.ok = false;
+            return;
+        }
+        skip_line();
+    }
+
+    void parse_lits(const DimacsItem::Kind kind) {
+        const size_t start = ch.lits.size();
+        int64_t l;
+        while (true) {
+            skip_space();
+            if (p == e) {
+                ch.open_end = true;
+                ch.lits.resize(start);
+                return;
+            }
+            if (!get_int(l, true)) {ch.ok = false; return;}
+            if (l == 0) break;
+            ch.lits.push_back(l);
+            ch.max_var = std::max<int32_t>(ch.max_var, std::abs(l));
+        }
+        ch.items.push_back(DimacsItem{kind, start});
+        if (kind == DimacsItem::clause) ch.num_cls++;
+        else ch.num_xors++;
+    }
+};
+
+// Checks the chunks as a whole: one header, before everything else, and
+// variables and number of constraints that match it
+inline bool check_dimacs_chunks(const std::vector<DimacsChunk>& chunks)
+{
+    bool header = false;
+    int64_t nvars = 0;
+    int64_t ncls = 0;
+    int32_t max_var = 0;
+    uint64_t num_cls = 0;
+    for (const auto& ch: chunks) {
+        if (!ch.ok || ch.open_end) return false;
+        for (const auto& it: ch.items) {
+            if (it.kind == DimacsItem::header) {
+                if (header) return false;
+                header = true;
+                nvars = ch.lits[it.start];
+                ncls = ch.lits[it.start+1];
+            } else if (!header) {
+                return false;
+            }
+        }
+        max_var = std::max(max_var, ch.max_var);
+        num_cls += ch.num_cls + ch.num_xors;
+    }
+    return header && max_var <= nvars && (int64_t)num_cls == ncls;
+}
+
+// Returns false if the file was not read, nothing was added to the reader
+// then and it should be read with DimacsParser
+template<class T>
+bool read_in_file_mmap(const std::string& filename, T* reader,
+    uint32_t threads, const uint32_t verb)
+{
+#ifndef APPMC_MMAP_PARSER
+    return false;
+#else
+    const double start_time = wallTime();
+    const int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+        close(fd);
+        return false;
+    }
+    const size_t size = st.st_size;
+    void* map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return false;
+    madvise(map, size, MADV_SEQUENTIAL);
+    const char* data = (const char*)map;
+
+    // gzip magic
+    if (size >= 2 && (unsigned char)data[0] == 0x1f && (unsigned char)data[1] == 0x8b) {
+        munmap(map, size);
+        return false;
+    }
+
+    // Chunks of at least 1MB, cut after a newline
+    const size_t min_chunk = 1ULL << 20;
+    threads = std::max<uint32_t>(1, std::min<uint64_t>(threads, size/min_chunk + 1));
+    std::vector<size_t> cuts = {0};
+    for (uint32_t i = 1; i < threads; i++) {
+        size_t at = std::max(cuts.back(), size/threads*i);
+        while (at < size && data[at] != '\n') at++;
+        if (at < size) at++;
+        if (at > cuts.back() && at < size) cuts.push_back(at);
+    }
+    cuts.push_back(size);
+
+    std::vector<DimacsChunk> chunks(cuts.size()-1);
+    auto parse_chunk = [&](size_t i) {
+        TraceSpan span("parse_chunk", "chunk", i);
+        DimacsChunkParser(data+cuts[i], data+cuts[i+1], chunks[i]).parse();
+    };
+    if (chunks.size() == 1) {
+        parse_chunk(0);
+    } else {
+        std::vector<std::thread> ths;
+        for (size_t i = 0; i < chunks.size(); i++) ths.emplace_back(parse_chunk, i);
+        for (auto& th: ths) th.join();
+    }
+
+    // A clause spans two chunks, parse again in one go
+    bool split_clause = false;
+    for (size_t i = 0; i+1 < chunks.size(); i++) split_clause |= chunks[i].open_end;
+    if (split_clause) {
+        chunks.clear();
+        chunks.resize(1);
+        DimacsChunkParser(data, data+size, chunks[0]).parse();
+    }
+    munmap(map, size);
+
+    if (!check_dimacs_chunks(chunks)) {
+        if (verb) std::cout << "c [appmc] Input is left to the DIMACS stream parser" << std::endl;
+        return false;
+    }
+
+    // Same calls, in the same order, as DimacsParser
+    std::vector<CMSat::Lit> lits;
+    std::vector<uint32_t> vars;
+    std::vector<uint32_t> sampl_vars;
+    bool sampl_vars_found = false;
+    uint64_t num_cls = 0;
+    uint64_t num_xors = 0;
+    for (auto& ch: chunks) {
+        for (size_t k = 0; k < ch.items.size(); k++) {
+            const DimacsItem& it = ch.items[k];
+            const size_t end = k+1 < ch.items.size() ? ch.items[k+1].start : ch.lits.size();
+            switch (it.kind) {
+                case DimacsItem::header: {
+                    const uint32_t nvars = ch.lits[it.start];
+                    if (reader->nVars() < nvars) reader->new_vars(nvars - reader->nVars());
+                    break;
+                }
+                case DimacsItem::clause:
+                    lits.clear();
+                    for (size_t i = it.start; i < end; i++) {
+                        lits.push_back(CMSat::Lit(std::abs(ch.lits[i])-1, ch.lits[i] < 0));
+                    }
+                    reader->add_clause(lits);
+                    num_cls++;
+                    break;
+                case DimacsItem::xor_clause: {
+                    bool rhs = true;
+                    vars.clear();
+                    for (size_t i = it.start; i < end; i++) {
+                        vars.push_back(std::abs(ch.lits[i])-1);
+                        rhs ^= ch.lits[i] < 0;
+                    }
+                    reader->add_xor_clause(vars, rhs);
+                    num_xors++;
+                    break;
+                }
+                case DimacsItem::ind:
+                    sampl_vars_found = true;
+                    for (size_t i = it.start; i < end; i++) sampl_vars.push_back(ch.lits[i]-1);
+                    break;
+            }
+        }
+        ch = DimacsChunk();
+    }
+    if (sampl_vars_found) reader->set_sampl_vars(sampl_vars);
+
+    if (verb) {
+        std::cout << "c [appmc] Parsed " << num_cls << " clauses and " << num_xors
+        << " XORs with " << threads << " threads"
+        << " T: " << std::fixed << std::setprecision(2) << (wallTime() - start_time)
+        << std::endl;
+    }
+    return true;
+#endif
+}
+
+}
@@ -0,0 +1,151 @@
+/*
+ ApproxMC
+
+ Copyright (c) 2019-2020, Mate Soos and Kuldeep S. Meel. All rights reserved
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#include "eventlog.h"
+
+#include <cmath>
+#include <cstdio>
+#if defined(_WIN32)
+#include <io.h>
+#define fdopen _fdopen
+#define dup _dup
+#else
+#include <unistd.h>
+#endif
+
+using std::string;
+
+namespace AppMCInt {
+
+static const size_t buf_size = 1 << 20;
+
+bool EventLog::open_file(const string& fname, const bool append)
+{
+    close();
+    out = fopen(fname.c_str(), append ? "a" : "w");
+    if (!out) return false;
+    setvbuf(out, nullptr, _IOFBF, buf_size);
+    return true;
+}
+
+// Written through a duplicate, so closing the log leaves the caller's fd open
+bool EventLog::open_fd(const int fd)
+{
+    close();
+    const int dup_fd = dup(fd);
+    if (dup_fd < 0) return false;
+    out = fdopen(dup_fd, "w");
+    if (!out) return false;
+    setvbuf(out, nullptr, _IOFBF, buf_size);
+    return true;
+}
+
+void EventLog::flush()
+{
+    if (out) fflush(out);
+}
+
+void EventLog::close()
+{
+    if (out) fclose(out);
+    out = nullptr;
+}
+
+EventLog& EventLog::begin(const char* ev, const double t)
+{
+    line.clear();
+    line += "{\"ev\":\"";
+    line += ev;
+    line += '"';
+    return add("t", t);
+}
+
+void EventLog::key(const char* k)
+{
+    line += ",\"";
+    line += k;
+    line += "\":";
+}
+
+EventLog& EventLog::add(const char* k, const uint64_t val)
+{
+    key(k);
+    line += std::to_string(val);
+    return *this;
+}
+
+EventLog& EventLog::add(const char* k, const int64_t val)
+{
+    key(k);
+    line += std::to_string(val);
+    return *this;
+}
+
+EventLog& EventLog::add(const char* k, const double val)
+{
+    key(k);
+    if (!std::isfinite(val)) {
+        line += "null";
+        return *this;
+    }
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.6g", val);
+    line += buf;
+    return *this;
+}
+
+EventLog& EventLog::add(const char* k, const bool val)
+{
+    key(k);
+    line += val ? "true" : "false";
+    return *this;
+}
+
+EventLog& EventLog::add(const char* k, const string& val)
+{
+    key(k);
+    line += '"';
+    for (const char c: val) {
+        if (c == '"' || c == '\\') {
+            line += '\\';
+            line += c;
+        } else if ((unsigned char)c < 0x20) {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", c);
+            line += buf;
+        } else {
+            line += c;
+        }
+    }
+    line += '"';
+    return *this;
+}
+
+void EventLog::write()
+{
+    line += "}\n";
+    if (out) fwrite(line.data(), 1, line.size(), out);
+}
+
+}
@@ -0,0 +1,75 @@
+/*
+ ApproxMC
+
+ Copyright (c) 2019-2020, Mate Soos and Kuldeep S. Meel. All rights reserved
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <string>
+#include <cstdio>
+#include <cstdint>
+
+namespace AppMCInt {
+
+// One JSON object per line. Every event has "ev", its kind, and "t", the
+// wall-clock seconds since the start of the count. Output is buffered and
+// only flushed at the end of a round and when closed, so it can stay on.
+//
+// The counter writes these kinds:
+//   start              options, threshold and number of rounds
+//   bounded_sol_count  one per call: round, hashes, solutions found, time
+//                      and the conflicts/propagations/decisions it took
+//   inter_simplify     simplification inside bounded_sol_count
+//   round              result of a round: hashes and cell count
+//   simplify           simplification between rounds
+//   estimate           the final count, also when stopped early
+class EventLog {
+public:
+    EventLog() = default;
+    EventLog(const EventLog&) = delete;
+    EventLog& operator=(const EventLog&) = delete;
+    ~EventLog() { close(); }
+
+    bool open_file(const std::string& fname, const bool append);
+    bool open_fd(const int fd); // the fd is not closed
+    bool is_open() const { return out != nullptr; }
+    void flush();
+    void close();
+
+    // Fields are added in order, then write() ends the line
+    EventLog& begin(const char* ev, const double t);
+    EventLog& add(const char* key, const uint64_t val);
+    EventLog& add(const char* key, const int64_t val);
+    EventLog& add(const char* key, const uint32_t val) { return add(key, (uint64_t)val); }
+    EventLog& add(const char* key, const int val) { return add(key, (int64_t)val); }
+    EventLog& add(const char* key, const double val);
+    EventLog& add(const char* key, const bool val);
+    EventLog& add(const char* key, const std::string& val);
+    void write();
+
+private:
+    void key(const char* k);
+    FILE* out = nullptr;
+    std::string line;
+};
+
+}
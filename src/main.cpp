@@ -33,6 +33,8 @@
 #endif
 #include <cstdint>
 #include <set>
+#include <sstream>
+#include <csignal>
 #include <gmp.h>
 
 #include "time_mem.h"
@@ -42,6 +44,13 @@
 #include <cryptominisat5/streambuffer.h>
 #include <arjun/arjun.h>
 #include "src/argparse.hpp"
+#include "dimacs_mmap.h"
+#include "snapshot.h"
+#include "batch.h"
+#include "daemon.h"
+#include "trace.h"
+#include "appmc_constants.h"
+#include "GitSHA1.h"
 
 using namespace CMSat;
 using std::cout;
@@ -60,7 +69,12 @@ string randfilename;
 double epsilon;
 double delta;
 string logfilename;
+int log_fd = -1;
 string certfilename;
+int cert_shards = 0;
+double max_time = 0;
+string checkpoint_fname;
+int resume = 0;
 uint32_t start_iter = 0;
 uint32_t verb_cls = 0;
 uint32_t simplify;
@@ -69,6 +83,7 @@ uint32_t reuse_models = 1;
 uint32_t force_sol_extension = 0;
 uint32_t sparse = 0;
 int dump_intermediary_cnf = 0;
+uint32_t parse_threads = 4;
 
 //Arjun
 int ignore_sampl_set = 0;
@@ -82,6 +97,29 @@ int e_vivif = 1;
 int e_sparsify = 0;
 int e_get_reds = 0;
 
+string snapshot_dir;
+
+//Ensemble, the seeds after the first one, which is counted by appmc
+uint32_t ensemble = 0;
+vector<ApproxMC::AppMC*> ensemble_members;
+
+//Batch
+string batch_manifest;
+AppMCInt::BatchConf batch_conf;
+
+//Daemon
+string daemon_socket;
+uint32_t daemon_queue = 64;
+uint32_t daemon_max_vars = AppMCInt::DaemonConf().max_vars;
+uint64_t daemon_max_cls = AppMCInt::DaemonConf().max_clauses;
+
+//Input file of the instance, empty: standard input
+string input_file;
+
+//Wall and CPU time of the steps before and around the count
+PhaseTimes phases;
+string trace_fname;
+
 #define myopt(name, var, fun, hhelp) \
     program.add_argument(name) \
         .action([&](const auto& a) {var = std::fun(a.c_str());}) \
@@ -117,11 +155,43 @@ void add_appmc_options()
             "The lower, the higher confidence we have in the count.");
     myopt("--ignore", ignore_sampl_set, atoi, "Ignore given sampling set and recompute it with Arjun");
     myopt("--randbits", randfilename, string, "Read random bits from this file.");
-    myopt("--cert", certfilename, string, "Put certification of ApproxMC execution to this file.");
+    myopt("--cert", certfilename, string, "Put certification of ApproxMC execution to this file. "
+            "Needs --arjun 0, the Arjun step cannot be certified");
+    myopt("--maxtime", max_time, stod, "Wall-clock time limit in seconds. When it is reached, "
+            "or on SIGINT/SIGTERM, the count is the median of the rounds done so far. In daemon mode, "
+            "the limit of every request. 0 = no limit");
+    myopt("--checkpoint", checkpoint_fname, string, "Save the state of the count to this file "
+            "every other round. It is removed when the count is done");
+    myopt("--resume", resume, atoi, "Go on from the checkpoint if there is one. Use the same input, "
+            "seed and options. With --snapshotdir, Arjun is not run again");
+    myopt("--certshards", cert_shards, atoi, "Write every round of the certificate to its own file, "
+            "certfile + '.<round>', so rounds can be checked in parallel");
 
     /* arjun_options.add_options() */
     myopt("--arjun", do_arjun, atoi, "Use arjun to minimize sampling set");
     myopt("--arjundebug", debug_arjun, atoi, "Use CNF from Arjun, but use sampling set from CNF");
+    myopt("--batch", batch_manifest, string, "Count every file listed in this file, one per line. "
+            "Passing more than one input file also counts them as a batch");
+    myopt("--jobs", batch_conf.jobs, atoi, "Number of instances counted at the same time "
+            "in batch and daemon mode");
+    myopt("--instmaxtime", batch_conf.max_time, atoi, "Wall-clock time limit in seconds "
+            "of an instance in batch mode. 0 = no limit");
+    myopt("--instmaxmem", batch_conf.max_mem, atoll, "Memory limit in MB of an instance in batch mode. "
+            "0 = no limit");
+    myopt("--daemon", daemon_socket, string, "Serve count requests on this Unix socket until "
+            "SIGINT or SIGTERM. See src/daemon.h for the protocol");
+    myopt("--daemonqueue", daemon_queue, atoi, "Requests waiting for a worker in daemon mode, "
+            "more are refused with status 'busy'");
+    myopt("--daemonmaxvars", daemon_max_vars, atoi, "Variables of a formula in daemon mode, "
+            "requests with more get an error reply");
+    myopt("--daemonmaxcls", daemon_max_cls, atoll, "Clauses and XORs of a formula in daemon mode, "
+            "requests with more get an error reply");
+    myopt("--snapshotdir", snapshot_dir, string, "Cache the formula after Arjun in this directory, "
+            "and load it from there when run again on the same input with the same Arjun options. "
+            "Arjun then runs with a fixed seed, so runs with any seed, epsilon or delta share it");
+    myopt("--ensemble", ensemble, atoi, "Count with this many seeds, seed, seed+1, ..., at the "
+            "same time on the formula after Arjun. The count is the median of the rounds of all "
+            "seeds, with the confidence of that many rounds. 0 or 1 = one seed");
 
     /* improvement_options.add_options() */
     myopt("--sparse", sparse, atoi,
@@ -142,8 +212,14 @@ void add_appmc_options()
     myopt("--velimratio", var_elim_ratio, stod, "Variable elimination ratio for each simplify run");
     myopt("--dumpintercnf", dump_intermediary_cnf, atoi,
             "Dump intermediary CNFs during solving into files cnf_dump-X.cnf. If set to 1 only UNSAT is dumped, if set to 2, all are dumped");
-    myopt("--log", logfilename, string, "Put logs of ApproxMC execution to this file");
+    myopt("--log", logfilename, string, "Write events of the count, one JSON object per line, "
+            "to this file");
+    myopt("--logfd", log_fd, atoi, "Write the events to this open file descriptor instead");
+    myopt("--trace", trace_fname, string, "Write a timeline of the run to this file, in Chrome "
+            "trace-event format. Open it in chrome://tracing or ui.perfetto.dev");
     myopt("--debug", debug, atoi, "Turn on more heavy internal debugging");
+    myopt("--parsethreads", parse_threads, atoi, "Threads to parse a plain DIMACS input file with. "
+            "0 = always use the stream parser");
 
     program.add_argument("inputfile").remaining().help("input CNF");
 }
@@ -172,6 +248,9 @@ void add_supported_options(int argc, char** argv) {
 
 template<class T> void read_in_file(const string& filename, T* myreader)
 {
+    if (parse_threads &&
+        AppMCInt::read_in_file_mmap(filename, myreader, parse_threads, verb)) return;
+
     #ifndef USE_ZLIB
     FILE * in = fopen(filename.c_str(), "rb");
     DimacsParser<StreamBuffer<FILE*, FN>, T> parser(myreader, nullptr, verb);
@@ -252,7 +331,7 @@ template<class T> void read_stdin(T* myreader) {
     #endif
 }
 
-void print_num_solutions(uint32_t cell_sol_cnt, uint32_t hash_count, const mpz_class& mult)
+mpz_class print_num_solutions(uint32_t cell_sol_cnt, uint32_t hash_count, const mpz_class& mult)
 {
     cout << "c [appmc] Number of solutions is: "
     << cell_sol_cnt << "*2**" << hash_count << "*" << mult << endl;
@@ -265,11 +344,12 @@ void print_num_solutions(uint32_t cell_sol_cnt, uint32_t hash_count, const mpz_c
     num_sols *= mult;
 
     cout << "s mc " << num_sols << endl;
+    return num_sols;
 }
 
-void get_cnf_from_arjun() {
+void get_cnf_from_arjun(AppMCInt::Snapshot& snap) {
     const uint32_t orig_num_vars = arjun->get_orig_num_vars();
-    appmc->new_vars(orig_num_vars);
+    snap.nvars = orig_num_vars;
     arjun->start_getting_constraints();
     vector<Lit> clause;
     bool is_xor, rhs;
@@ -277,24 +357,16 @@ void get_cnf_from_arjun() {
         assert(!is_xor); assert(rhs);
         bool ok = true;
         for(auto l: clause) if (l.var() >= orig_num_vars) { ok = false; break; }
-        if (ok) appmc->add_clause(clause);
+        if (ok) snap.cnf.push_back(clause);
     }
     arjun->end_getting_constraints();
 }
 
 template<class T> void read_input_cnf(T* reader) {
-    try {
-        auto files = program.get<std::vector<std::string>>("inputfile");
-        if (files.size() > 1) {
-            cout << "ERROR: you can only pass at most one positional option, an INPUT file" << endl;
-            exit(-1);
-        }
-        assert(!files.empty());
-        const string inp = files[0];
-        read_in_file(inp, reader);
-    } catch (std::logic_error& e) {
-        read_stdin(reader);
-    }
+    PhaseTimer timer(phases, "parse");
+    AppMCInt::TraceSpan span("parse");
+    if (input_file.empty()) read_stdin(reader);
+    else read_in_file(input_file, reader);
     if (!reader->get_sampl_vars_set()  || ignore_sampl_set) {
         vector<uint32_t> all_vars;
         for(uint32_t i = 0; i < reader->nVars(); i++) all_vars.push_back(i);
@@ -327,11 +399,16 @@ void set_approxmc_options()
         appmc->set_dump_intermediary_cnf(std::max(dump_intermediary_cnf, 1));
     }
 
-    if (!logfilename.empty()) {
+    if (log_fd >= 0) {
+        appmc->set_up_log_fd(log_fd);
+        cout << "c [appmc] Log to fd " << log_fd << endl;
+    } else if (!logfilename.empty()) {
         appmc->set_up_log(logfilename);
         cout << "c [appmc] Logfile set " << logfilename << endl;
     }
 
+    if (!checkpoint_fname.empty()) appmc->set_checkpoint(checkpoint_fname, resume);
+
     if (randfilename != "") {
         appmc->set_up_randbits(randfilename);
         cout << "c [appmc] random bits file set " << randfilename << endl;
@@ -341,6 +418,7 @@ void set_approxmc_options()
         appmc->set_up_cert(certfilename);
         cout << "c [appmc] Certification file set " << certfilename << endl;
     } 
+    appmc->set_cert_shards(cert_shards);
 }
 
 template<class T>
@@ -359,92 +437,409 @@ void print_orig_sampling_vars(const vector<uint32_t>& orig_sampling_vars, T* ptr
     }
 }
 
-void transfer_unit_clauses_from_arjun()
+void transfer_unit_clauses_from_arjun(AppMCInt::Snapshot& snap)
 {
     vector<Lit> cl(1);
     auto units = arjun->get_zero_assigned_lits();
     for(const auto& unit: units) {
-        if (unit.var() < appmc->nVars()) {
+        if (unit.var() < snap.nvars) {
             cl[0] = unit;
-            appmc->add_clause(cl);
+            snap.cnf.push_back(cl);
         }
     }
 }
 
-int main(int argc, char** argv)
+// Runs Arjun on the input, the result is what AppMC will count
+void run_arjun(AppMCInt::Snapshot& snap)
 {
-    #if defined(__GNUC__) && defined(__linux__)
-    feenableexcept(FE_INVALID   | FE_DIVBYZERO | FE_OVERFLOW);
-    #endif
-    double start_time = cpuTime();
+    read_input_cnf(arjun);
+    print_orig_sampling_vars(arjun->get_orig_sampl_vars(), arjun);
+    auto debug_sampling_vars = arjun->get_orig_sampl_vars();
+    PhaseTimer timer(phases, "arjun");
+    AppMCInt::TraceSpan span("arjun");
+    vector<uint32_t> sampl_vars;
+    {
+        AppMCInt::TraceSpan backw_span("arjun_backward");
+        sampl_vars = arjun->run_backwards();
+    }
+    print_final_indep_set(sampl_vars, arjun->get_orig_sampl_vars().size(),
+            arjun->get_empty_sampl_vars());
+    snap.orig_sampl_vars_size = arjun->get_orig_sampl_vars().size();
+    if (with_e) {
+        ArjunNS::SimpConf sc;
+        sc.appmc = true;
+        sc.oracle_vivify = e_vivif;
+        sc.oracle_vivify_get_learnts = true;
+        sc.oracle_sparsify = e_sparsify;
+        sc.iter1 = e_iter_1;
+        sc.iter2 = e_iter_2;
+        AppMCInt::TraceSpan simp_span("arjun_simplify");
+        auto ret = arjun->get_fully_simplified_renumbered_cnf(sc);
+        snap.nvars = ret.nvars;
+        snap.cnf = std::move(ret.cnf);
+        if (e_get_reds) snap.red_cnf = std::move(ret.red_cnf);
+        sampl_vars = ret.sampl_vars;
+        snap.multiplier_weight = ret.multiplier_weight;
+    } else {
+        get_cnf_from_arjun(snap);
+        transfer_unit_clauses_from_arjun(snap);
+        mpz_class dummy(2);
+        mpz_pow_ui(dummy.get_mpz_t(), dummy.get_mpz_t(), arjun->get_empty_sampl_vars().size());
+        snap.multiplier_weight = arjun->get_multiplier_weight()*dummy;
+    }
+    if (debug_arjun) {
+        assert(!with_e && "Can't use debug and --withe at the same time");
+        sampl_vars = debug_sampling_vars;
+        snap.multiplier_weight = 1;
+    }
+    snap.sampl_vars = sampl_vars;
+}
 
-    //Reconstruct the command line so we can emit it later if needed
-    string command_line;
-    for(int i = 0; i < argc; i++) {
-        command_line += string(argv[i]);
-        if (i+1 < argc) command_line += " ";
+// Arjun's seed when snapshots are used, so that runs with other seeds share
+// the snapshot. The seed of the count is not pinned.
+const uint32_t snapshot_arjun_seed = 1;
+
+// Everything that changes what Arjun hands to AppMC, empty if the snapshot
+// cannot be used
+string get_snapshot_key()
+{
+    if (snapshot_dir.empty()) return string();
+    if (input_file.empty()) {
+        cout << "c [appmc] Snapshots are not used when reading from standard input" << endl;
+        return string();
     }
+    std::stringstream opts;
+    opts << "appmc=" << AppMCInt::get_version_sha1()
+    << " arjun=" << arjun->get_version_info()
+    << " simplify=" << simplify
+    << " ignore=" << ignore_sampl_set << " arjundebug=" << debug_arjun
+    << " withe=" << with_e << " eiter1=" << e_iter_1 << " eiter2=" << e_iter_2
+    << " evivif=" << e_vivif << " esparsif=" << e_sparsify << " egetreds=" << e_get_reds;
+    return AppMCInt::snapshot_key(input_file, opts.str());
+}
 
-    appmc = new ApproxMC::AppMC;
-    add_supported_options(argc, argv);
-    if (verb) {
-        cout << appmc->get_version_info();
-        cout << "c executed with command line: " << command_line << endl;
+vector<string> get_input_files()
+{
+    try {
+        return program.get<std::vector<std::string>>("inputfile");
+    } catch (std::logic_error& e) {
+        return vector<string>();
+    }
+}
+
+void start_trace()
+{
+    if (trace_fname.empty()) return;
+    if (!AppMCInt::trace_start(trace_fname)) {
+        cout << "c [appmc] ERROR: cannot write trace file " << trace_fname << endl;
+        exit(-1);
+    }
+    AppMCInt::trace_thread_name("main");
+}
+
+void stop_trace()
+{
+    if (trace_fname.empty()) return;
+    if (AppMCInt::trace_stop()) {
+        cout << "c [appmc] Wrote trace " << trace_fname << endl;
+    } else {
+        cout << "c [appmc] WARNING: could not write trace " << trace_fname << endl;
     }
+}
+
+// Stops the count at the next SAT call, a second signal kills as usual
+void stop_count_signal(int sig)
+{
+    if (appmc) appmc->interrupt_asap();
+    for(auto* m: ensemble_members) m->interrupt_asap();
+    signal(sig, SIG_DFL);
+}
+
+void load_snapshot(ApproxMC::AppMC* a, const AppMCInt::Snapshot& snap)
+{
+    a->new_vars(snap.nvars);
+    for(const auto& cl: snap.cnf) a->add_clause(cl);
+    for(const auto& cl: snap.red_cnf) a->add_red_clause(cl);
+    a->set_multiplier_weight(snap.multiplier_weight);
+    a->set_sampl_vars(snap.sampl_vars);
+}
+
+// The files the count writes would be written by every seed
+void check_ensemble_options()
+{
+    string opt;
+    if (!certfilename.empty()) opt = "--cert";
+    else if (!checkpoint_fname.empty()) opt = "--checkpoint";
+    else if (!logfilename.empty() || log_fd >= 0) opt = "--log";
+    else if (!randfilename.empty()) opt = "--randbits";
+    else if (!do_arjun) opt = "--arjun 0";
+    if (!opt.empty()) {
+        cout << "c [appmc] ERROR: --ensemble cannot be used with " << opt << endl;
+        exit(-1);
+    }
+}
+
+// Each seed has its own solver, only the formula after Arjun is shared
+void add_ensemble_members(const AppMCInt::Snapshot& snap)
+{
+    for(uint32_t i = 1; i < ensemble; i++) {
+        auto* m = new ApproxMC::AppMC;
+        m->set_verbosity(0);
+        m->set_seed(seed+i);
+        m->set_epsilon(epsilon);
+        m->set_delta(delta);
+        m->set_reuse_models(reuse_models);
+        m->set_sparse(sparse);
+        m->set_start_iter(start_iter);
+        m->set_simplify(simplify);
+        m->set_var_elim_ratio(var_elim_ratio);
+        m->set_force_sol_extension(force_sol_extension);
+        load_snapshot(m, snap);
+        ensemble_members.push_back(m);
+    }
+}
+
+// Counts with appmc and the other seeds at the same time. Rounds with
+// different seeds are independent, so the count is the median of the rounds
+// of all of them, the same way a single count takes the median of its own.
+ApproxMC::SolCount count_ensemble(bool& stopped_early, uint32_t& rounds, double& eff_delta)
+{
+    vector<ApproxMC::AppMC*> all = {appmc};
+    all.insert(all.end(), ensemble_members.begin(), ensemble_members.end());
+    vector<ApproxMC::CountHandle> handles;
+    for(auto* a: all) handles.push_back(a->count_async());
+    vector<ApproxMC::SolCount> counts;
+    for(auto& h: handles) counts.push_back(h.result.get());
+
+    stopped_early = false;
+    rounds = 0;
+    vector<uint32_t> hashes;
+    vector<uint64_t> cells;
+    for(size_t i = 0; i < all.size(); i++) {
+        const auto& st = all[i]->get_count_stats();
+        cout << "c [appmc] Ensemble seed " << seed+i << ": ";
+        if (counts[i].valid) cout << counts[i].cellSolCount << "*2**" << counts[i].hashCount;
+        else cout << "no count";
+        cout << " rounds: " << all[i]->get_rounds_done()
+        << " T: " << std::fixed << std::setprecision(2) << st.wall << endl;
+        stopped_early |= all[i]->get_stopped_early();
+        hashes.insert(hashes.end(), st.round_hashes.begin(), st.round_hashes.end());
+        cells.insert(cells.end(), st.round_cells.begin(), st.round_cells.end());
+    }
+
+    ApproxMC::SolCount ret;
+    eff_delta = 1;
+    for(size_t i = 0; i < all.size(); i++) {
+        // Counted without XORs, that is exact
+        if (counts[i].valid && counts[i].hashCount == 0) {
+            eff_delta = 0;
+            return counts[i];
+        }
+    }
+    rounds = cells.size();
+    if (cells.empty()) return ret;
+
+    const uint32_t min_hash = *std::min_element(hashes.begin(), hashes.end());
+    for(size_t i = 0; i < cells.size(); i++) {
+        if (hashes[i] - min_hash > 10) {
+            cout << "c [appmc] ERROR: the rounds of the seeds are too far apart to be combined" << endl;
+            exit(-1);
+        }
+        cells[i] <<= hashes[i] - min_hash;
+    }
+    std::sort(cells.begin(), cells.end());
+    ret.valid = true;
+    ret.cellSolCount = cells[cells.size()/2];
+    ret.hashCount = min_hash;
+
+    const auto& confs = AppMCInt::Constants::get().iterationConfidences;
+    eff_delta = 1.0 - confs[std::min<size_t>((cells.size()-1)/2, confs.size()-1)];
+    cout << "c [appmc] Ensemble of " << all.size() << " seeds, median of " << cells.size()
+    << " rounds, effective delta: " << eff_delta << endl;
+    return ret;
+}
+
+// Counts input_file with the global appmc, which it deletes. Returns false
+// if it was stopped before a count was made
+bool count_instance(const double start_time, mpz_class& num_sols)
+{
+    const double wall_start = wallTime();
+    phases.clear();
+    start_trace();
+    // The certificate would be about the formula after Arjun, and nothing
+    // certifies that its count times the multiplier is that of the input
+    if (!certfilename.empty() && do_arjun) {
+        cout << "c [appmc] ERROR: --cert needs --arjun 0, the Arjun step cannot be certified" << endl;
+        exit(-1);
+    }
+    if (ensemble > 1) check_ensemble_options();
     set_approxmc_options();
 
     if (do_arjun) {
         //Arjun-based minimization
         arjun = new ArjunNS::Arjun;
-        arjun->set_seed(seed);
         arjun->set_verbosity(verb);
         arjun->set_simp(simplify);
         if (verb) cout << "c Arjun SHA revision " <<  arjun->get_version_info() << endl;
 
-        read_input_cnf(arjun);
-        print_orig_sampling_vars(arjun->get_orig_sampl_vars(), arjun);
-        auto debug_sampling_vars = arjun->get_orig_sampl_vars();
-        auto sampl_vars = arjun->run_backwards();
-        print_final_indep_set(sampl_vars, arjun->get_orig_sampl_vars().size(),
-                arjun->get_empty_sampl_vars());
-        if (with_e) {
-            ArjunNS::SimpConf sc;
-            sc.appmc = true;
-            sc.oracle_vivify = e_vivif;
-            sc.oracle_vivify_get_learnts = true;
-            sc.oracle_sparsify = e_sparsify;
-            sc.iter1 = e_iter_1;
-            sc.iter2 = e_iter_2;
-            const auto ret = arjun->get_fully_simplified_renumbered_cnf(sc);
-            appmc->new_vars(ret.nvars);
-            for(const auto& cl: ret.cnf) appmc->add_clause(cl);
-            if (e_get_reds) for(const auto& cl: ret.red_cnf) appmc->add_red_clause(cl);
-            sampl_vars = ret.sampl_vars;
-            appmc->set_multiplier_weight(ret.multiplier_weight);
-        } else {
-            get_cnf_from_arjun();
-            transfer_unit_clauses_from_arjun();
-            mpz_class dummy(2);
-            mpz_pow_ui(dummy.get_mpz_t(), dummy.get_mpz_t(), arjun->get_empty_sampl_vars().size());
-            appmc->set_multiplier_weight(arjun->get_multiplier_weight()*dummy);
+        AppMCInt::Snapshot snap;
+        const string snap_key = get_snapshot_key();
+        arjun->set_seed(snap_key.empty() ? seed : snapshot_arjun_seed);
+        const string snap_fname = snap_key.empty() ? string()
+            : AppMCInt::snapshot_fname(snapshot_dir, snap_key);
+        bool loaded = false;
+        if (!snap_key.empty()) {
+            PhaseTimer timer(phases, "snapshot");
+            AppMCInt::TraceSpan span("snapshot");
+            loaded = AppMCInt::read_snapshot(snap_fname, snap_key, snap);
         }
-        if (debug_arjun) {
-            assert(!with_e && "Can't use debug and --withe at the same time");
-            sampl_vars = debug_sampling_vars;
-            appmc->set_multiplier_weight(1);
+        if (loaded) {
+            cout << "c [appmc] Loaded formula after Arjun from snapshot " << snap_fname << endl;
+        } else {
+            run_arjun(snap);
+            if (!snap_key.empty()) {
+                PhaseTimer timer(phases, "snapshot");
+                AppMCInt::TraceSpan span("snapshot");
+                if (AppMCInt::write_snapshot(snap_fname, snap_key, snap)) {
+                    cout << "c [appmc] Wrote snapshot " << snap_fname << endl;
+                } else {
+                    cout << "c [appmc] WARNING: could not write snapshot " << snap_fname << endl;
+                }
+            }
         }
-        appmc->set_sampl_vars(sampl_vars);
         delete arjun;
+        arjun = nullptr;
+
+        load_snapshot(appmc, snap);
+        if (ensemble > 1) add_ensemble_members(snap);
     } else {
         read_input_cnf(appmc);
         print_final_indep_set(appmc->get_sampl_vars() , 0, vector<uint32_t>());
     }
 
+    // The time limit covers parsing and Arjun too
+    if (max_time > 0) {
+        const double left = std::max(max_time - (wallTime() - wall_start), 0.001);
+        appmc->set_max_time(left);
+        for(auto* m: ensemble_members) m->set_max_time(left);
+    }
+    signal(SIGINT, stop_count_signal);
+    signal(SIGTERM, stop_count_signal);
     ApproxMC::SolCount sol_count;
-    sol_count = appmc->count();
+    bool stopped_early;
+    uint32_t rounds;
+    double eff_delta;
+    {
+        PhaseTimer timer(phases, "count");
+        AppMCInt::TraceSpan span("count");
+        if (ensemble > 1) {
+            sol_count = count_ensemble(stopped_early, rounds, eff_delta);
+        } else {
+            sol_count = appmc->count();
+            stopped_early = appmc->get_stopped_early();
+            rounds = appmc->get_rounds_done();
+            eff_delta = appmc->get_effective_delta();
+        }
+    }
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
     appmc->print_stats(start_time);
-    cout << "c [appmc+arjun] Total time: " << (cpuTime() - start_time) << endl;
-    print_num_solutions(sol_count.cellSolCount, sol_count.hashCount, appmc->get_multiplier_weight());
+    phases.print(cout, "c [appmc+arjun] ");
+    stop_trace();
+    cout << "c [appmc+arjun] Total time: " << (cpuTime() - start_time)
+    << " wall: " << (wallTime() - wall_start)
+    << " peak mem: " << (memPeakTotal() >> 20) << " MB" << endl;
+
+    bool ok = true;
+    if (stopped_early) {
+        cout << "c [appmc] WARNING: stopped early, rounds used: " << rounds
+        << " effective delta: " << eff_delta << endl;
+        if (!certfilename.empty() && sol_count.valid) {
+            cout << "c [appmc] The certificate holds these rounds only, "
+            "check it with a delta above the effective delta" << endl;
+        }
+        ok = sol_count.valid;
+    }
+    if (ok) {
+        num_sols = print_num_solutions(
+            sol_count.cellSolCount, sol_count.hashCount, appmc->get_multiplier_weight());
+    } else {
+        cout << "s UNKNOWN" << endl;
+    }
 
     delete appmc;
+    appmc = nullptr;
+    for(auto* m: ensemble_members) delete m;
+    ensemble_members.clear();
+    return ok;
+}
+
+// Every instance is counted in a child process with its own copy of appmc,
+// the files it writes get the index of the instance as suffix
+int count_batch(vector<string> files)
+{
+    if (!batch_manifest.empty()) {
+        const auto listed = AppMCInt::read_batch_manifest(batch_manifest);
+        files.insert(files.end(), listed.begin(), listed.end());
+    }
+    const uint32_t failed = AppMCInt::run_batch(files, batch_conf,
+        [](size_t idx, const string& fname) {
+            input_file = fname;
+            if (!logfilename.empty()) logfilename += "." + std::to_string(idx);
+            if (!certfilename.empty()) certfilename += "." + std::to_string(idx);
+            if (!checkpoint_fname.empty()) checkpoint_fname += "." + std::to_string(idx);
+            if (!trace_fname.empty()) trace_fname += "." + std::to_string(idx);
+            mpz_class num_sols;
+            if (!count_instance(cpuTime(), num_sols)) return string();
+            return num_sols.get_str();
+        });
+    delete appmc;
+    return failed == 0 ? 0 : 1;
+}
+
+int main(int argc, char** argv)
+{
+    #if defined(__GNUC__) && defined(__linux__)
+    feenableexcept(FE_INVALID   | FE_DIVBYZERO | FE_OVERFLOW);
+    #endif
+    double start_time = cpuTime();
+
+    //Reconstruct the command line so we can emit it later if needed
+    string command_line;
+    for(int i = 0; i < argc; i++) {
+        command_line += string(argv[i]);
+        if (i+1 < argc) command_line += " ";
+    }
+
+    appmc = new ApproxMC::AppMC;
+    add_supported_options(argc, argv);
+    if (verb) {
+        cout << appmc->get_version_info();
+        cout << "c executed with command line: " << command_line << endl;
+    }
+
+    if (!daemon_socket.empty()) {
+        AppMCInt::DaemonConf conf;
+        conf.socket_path = daemon_socket;
+        conf.workers = batch_conf.jobs;
+        conf.max_queued = daemon_queue;
+        conf.max_vars = daemon_max_vars;
+        conf.max_clauses = daemon_max_cls;
+        conf.max_time = max_time;
+        conf.verb = verb;
+        conf.epsilon = epsilon;
+        conf.delta = delta;
+        conf.seed = seed;
+        delete appmc;
+        start_trace();
+        const int ret = AppMCInt::run_daemon(conf);
+        stop_trace();
+        return ret;
+    }
+
+    const vector<string> files = get_input_files();
+    if (files.size() > 1 || !batch_manifest.empty()) return count_batch(files);
+    if (!files.empty()) input_file = files[0];
+    mpz_class num_sols;
+    return count_instance(start_time, num_sols) ? 0 : 1;
 }
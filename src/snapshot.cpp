@@ -0,0 +1,214 @@
+/*
+ ApproxMC
+
+ Copyright (c) 2019-2020, Mate Soos and Kuldeep S. Meel. All rights reserved
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#include "snapshot.h"
+
+#include <fstream>
+#include <algorithm>
+#include <sstream>
+#include <iomanip>
+#include <cstdio>
+#include <unistd.h>
+
+using std::string;
+using std::vector;
+using namespace CMSat;
+
+namespace AppMCInt {
+
+// Format: magic, version, key, then the formula, then an end marker so that
+// a truncated file is not used. Integers are little-endian, so a snapshot
+// directory can be shared between hosts.
+static const char snap_magic[8] = {'A', 'P', 'P', 'M', 'C', 'S', 'N', 'P'};
+static const char snap_end[8] = {'A', 'P', 'P', 'M', 'C', 'E', 'N', 'D'};
+static const uint32_t snap_version = 1;
+
+// 64-bit FNV-1a, two of them with different offsets make the digest
+struct Fnv64 {
+    explicit Fnv64(uint64_t _h) : h(_h) {}
+    uint64_t h;
+    void add(const char* data, size_t len) {
+        for (size_t i = 0; i < len; i++) {
+            h ^= (unsigned char)data[i];
+            h *= 0x100000001b3ULL;
+        }
+    }
+};
+
+static string to_hex(uint64_t a, uint64_t b)
+{
+    std::stringstream ss;
+    ss << std::hex << std::setfill('0') << std::setw(16) << a << std::setw(16) << b;
+    return ss.str();
+}
+
+string snapshot_key(const string& input_file, const string& options)
+{
+    std::ifstream in(input_file, std::ios::binary);
+    if (!in) return string();
+    Fnv64 h1(0xcbf29ce484222325ULL);
+    Fnv64 h2(0x84222325cbf29ce4ULL);
+    vector<char> buf(1 << 20);
+    uint64_t size = 0;
+    while (in) {
+        in.read(buf.data(), buf.size());
+        h1.add(buf.data(), in.gcount());
+        h2.add(buf.data(), in.gcount());
+        size += in.gcount();
+    }
+    if (in.bad()) return string();
+    return options + " size=" + std::to_string(size) + " digest=" + to_hex(h1.h, h2.h);
+}
+
+string snapshot_fname(const string& dir, const string& key)
+{
+    Fnv64 h1(0xcbf29ce484222325ULL);
+    Fnv64 h2(0x84222325cbf29ce4ULL);
+    h1.add(key.data(), key.size());
+    h2.add(key.data(), key.size());
+    return dir + "/" + to_hex(h1.h, h2.h) + ".appmcsnap";
+}
+
+class SnapWriter {
+public:
+    explicit SnapWriter(std::ofstream& _out) : out(_out) {}
+    void u32(uint32_t x) {le(x, 4);}
+    void u64(uint64_t x) {le(x, 8);}
+    void str(const string& s) {u64(s.size()); out.write(s.data(), s.size());}
+    void cls(const vector<vector<Lit>>& cs) {
+        u64(cs.size());
+        for (const auto& cl: cs) {
+            u32(cl.size());
+            for (const Lit l: cl) u32(l.toInt());
+        }
+    }
+
+private:
+    std::ofstream& out;
+    void le(uint64_t x, const int bytes) {
+        char b[8];
+        for (int i = 0; i < bytes; i++) b[i] = (char)(x >> (8*i));
+        out.write(b, bytes);
+    }
+};
+
+class SnapReader {
+public:
+    explicit SnapReader(std::ifstream& _in) : in(_in) {}
+    bool ok() const {return (bool)in;}
+    uint32_t u32() {return le(4);}
+    uint64_t u64() {return le(8);}
+    string str(const uint64_t max_len) {
+        const uint64_t len = u64();
+        if (!ok() || len > max_len) {in.setstate(std::ios::failbit); return string();}
+        string s(len, '\0');
+        in.read(&s[0], len);
+        return s;
+    }
+    void cls(vector<vector<Lit>>& cs, const uint32_t nvars) {
+        const uint64_t num = u64();
+        cs.clear();
+        for (uint64_t i = 0; i < num && ok(); i++) {
+            const uint32_t sz = u32();
+            if (sz > 2*(uint64_t)nvars) {in.setstate(std::ios::failbit); return;}
+            vector<Lit> cl(sz);
+            for (auto& l: cl) {
+                l = Lit::toLit(u32());
+                if (l.var() >= nvars) in.setstate(std::ios::failbit);
+            }
+            cs.push_back(std::move(cl));
+        }
+    }
+
+private:
+    std::ifstream& in;
+    uint64_t le(const int bytes) {
+        unsigned char b[8];
+        if (!in.read((char*)b, bytes)) return 0;
+        uint64_t x = 0;
+        for (int i = 0; i < bytes; i++) x |= (uint64_t)b[i] << (8*i);
+        return x;
+    }
+};
+
+bool read_snapshot(const string& fname, const string& key, Snapshot& snap)
+{
+    std::ifstream in(fname, std::ios::binary);
+    if (!in) return false;
+    SnapReader r(in);
+
+    char magic[8];
+    in.read(magic, 8);
+    if (!r.ok() || !std::equal(magic, magic+8, snap_magic)) return false;
+    if (r.u32() != snap_version) return false;
+    if (r.str(key.size()) != key || !r.ok()) return false;
+
+    snap.nvars = r.u32();
+    snap.orig_sampl_vars_size = r.u32();
+    const string mult = r.str(1ULL << 20);
+    if (!r.ok() || snap.multiplier_weight.set_str(mult, 10) != 0) return false;
+    const uint64_t num_sampl = r.u64();
+    if (!r.ok() || num_sampl > snap.nvars) return false;
+    snap.sampl_vars.resize(num_sampl);
+    for (auto& v: snap.sampl_vars) {
+        v = r.u32();
+        if (v >= snap.nvars) return false;
+    }
+    r.cls(snap.cnf, snap.nvars);
+    r.cls(snap.red_cnf, snap.nvars);
+
+    in.read(magic, 8);
+    return r.ok() && std::equal(magic, magic+8, snap_end);
+}
+
+// Written to a temporary file first, so that a concurrent run never reads a
+// half-written snapshot
+bool write_snapshot(const string& fname, const string& key, const Snapshot& snap)
+{
+    const string tmp_fname = fname + ".tmp" + std::to_string(getpid());
+    std::ofstream out(tmp_fname, std::ios::binary);
+    if (!out) return false;
+    SnapWriter w(out);
+
+    out.write(snap_magic, 8);
+    w.u32(snap_version);
+    w.str(key);
+    w.u32(snap.nvars);
+    w.u32(snap.orig_sampl_vars_size);
+    w.str(snap.multiplier_weight.get_str());
+    w.u64(snap.sampl_vars.size());
+    for (const uint32_t v: snap.sampl_vars) w.u32(v);
+    w.cls(snap.cnf);
+    w.cls(snap.red_cnf);
+    out.write(snap_end, 8);
+    out.close();
+
+    if (!out || std::rename(tmp_fname.c_str(), fname.c_str()) != 0) {
+        std::remove(tmp_fname.c_str());
+        return false;
+    }
+    return true;
+}
+
+}
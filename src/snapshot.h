@@ -0,0 +1,57 @@
+/*
+ ApproxMC
+
+ Copyright (c) 2019-2020, Mate Soos and Kuldeep S. Meel. All rights reserved
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <gmpxx.h>
+#include <cryptominisat5/solvertypesmini.h>
+
+namespace AppMCInt {
+
+// The formula Arjun hands to AppMC. It is cached on disk so that later runs
+// on the same input with the same Arjun options skip parsing and Arjun.
+struct Snapshot {
+    uint32_t nvars = 0;
+    std::vector<std::vector<CMSat::Lit>> cnf;
+    std::vector<std::vector<CMSat::Lit>> red_cnf;
+    std::vector<uint32_t> sampl_vars;
+    mpz_class multiplier_weight = 1;
+    uint32_t orig_sampl_vars_size = 0;
+};
+
+// Key of a snapshot: the options that change what Arjun hands to AppMC and a
+// digest of the input file. Empty if the file cannot be read.
+std::string snapshot_key(const std::string& input_file, const std::string& options);
+
+// File of the snapshot with the given key in the directory
+std::string snapshot_fname(const std::string& dir, const std::string& key);
+
+// Returns false if there is no snapshot for the key, or it is unusable
+bool read_snapshot(const std::string& fname, const std::string& key, Snapshot& snap);
+bool write_snapshot(const std::string& fname, const std::string& key, const Snapshot& snap);
+
+}
@@ -32,6 +32,10 @@ THE SOFTWARE.
 #include <fstream>
 #include <string>
 #include <csignal>
+#include <chrono>
+#include <deque>
+#include <algorithm>
+#include <iomanip>
 
 // note: MinGW64 defines both __MINGW32__ and __MINGW64__
 #if defined (_MSC_VER) || defined (__MINGW32__) || defined(_WIN32)
@@ -140,3 +144,89 @@ static inline size_t memUsedTotal(double& vm_usage)
     return 0;
 }
 #endif
+
+// Monotonic wall-clock time in seconds, for time differences only
+static inline double wallTime(void)
+{
+    using namespace std::chrono;
+    return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+// Peak resident set size of the process in bytes, 0 if unknown
+#if defined (_MSC_VER) || defined (__MINGW32__) || defined(_WIN32)
+static inline uint64_t memPeakTotal(void)
+{
+    return 0;
+}
+#else
+static inline uint64_t memPeakTotal(void)
+{
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru) != 0) return 0;
+    #if defined(__APPLE__)
+    return ru.ru_maxrss;
+    #else
+    return (uint64_t)ru.ru_maxrss*1024;
+    #endif
+}
+#endif
+
+// Time spent in named phases, e.g. parsing or simplifying. A phase can be
+// entered many times, its calls add up. CPU time is that of the whole
+// process, so it includes other threads working at the same time.
+struct PhaseStat {
+    std::string name;
+    uint64_t calls = 0;
+    double wall = 0;
+    double cpu = 0;
+    uint64_t peak_rss = 0;
+};
+
+class PhaseTimes {
+public:
+    PhaseStat& get(const char* name) {
+        for (auto& p: phases) if (p.name == name) return p;
+        phases.push_back(PhaseStat());
+        phases.back().name = name;
+        return phases.back();
+    }
+    const std::deque<PhaseStat>& all() const { return phases; }
+    void clear() { phases.clear(); }
+
+    void print(std::ostream& out, const std::string& prefix) const {
+        if (phases.empty()) return;
+        out << prefix << std::left << std::setw(18) << "phase" << std::right
+        << std::setw(8) << "calls" << std::setw(10) << "wall s"
+        << std::setw(10) << "cpu s" << std::setw(10) << "peak MB" << std::endl;
+        for (const auto& p: phases) {
+            out << prefix << std::left << std::setw(18) << p.name << std::right
+            << std::setw(8) << p.calls
+            << std::fixed << std::setprecision(2)
+            << std::setw(10) << p.wall << std::setw(10) << p.cpu
+            << std::setw(10) << (p.peak_rss >> 20) << std::endl;
+        }
+    }
+
+private:
+    std::deque<PhaseStat> phases; //stable references for running timers
+};
+
+// Adds the time between its construction and destruction to a phase
+class PhaseTimer {
+public:
+    PhaseTimer(PhaseTimes& times, const char* name) :
+        stat(times.get(name)), start_wall(wallTime()), start_cpu(cpuTimeTotal()) {}
+    ~PhaseTimer() {
+        stat.calls++;
+        stat.wall += wall();
+        stat.cpu += cpu();
+        stat.peak_rss = std::max(stat.peak_rss, memPeakTotal());
+    }
+    double wall() const { return wallTime() - start_wall; }
+    double cpu() const { return cpuTimeTotal() - start_cpu; }
+
+private:
+    PhaseStat& stat;
+    const double start_wall;
+    const double start_cpu;
+};
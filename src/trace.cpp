@@ -0,0 +1,157 @@
+/*
+ ApproxMC
+
+ Copyright (c) 2019-2020, Mate Soos and Kuldeep S. Meel. All rights reserved
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#include "trace.h"
+
+#include <chrono>
+#include <mutex>
+#include <memory>
+#include <fstream>
+
+using std::string;
+using std::vector;
+
+namespace AppMCInt {
+
+std::atomic<bool> trace_on{false};
+
+namespace {
+
+struct ThreadBuffer {
+    uint32_t tid;
+    string name;
+    vector<TraceEvent> events;
+};
+
+struct Tracer {
+    std::mutex mu; // only taken when a thread records its first span
+    vector<std::unique_ptr<ThreadBuffer>> buffers;
+    string fname;
+    std::chrono::steady_clock::time_point start;
+    std::atomic<uint32_t> generation{0};
+};
+
+Tracer tracer;
+
+struct ThreadSlot {
+    ThreadBuffer* buf = nullptr;
+    uint32_t generation = 0;
+};
+thread_local ThreadSlot slot;
+
+// Buffers outlive their threads, so the trace keeps the spans of workers
+// that are done
+ThreadBuffer* thread_buffer()
+{
+    const uint32_t gen = tracer.generation.load(std::memory_order_acquire);
+    if (slot.buf && slot.generation == gen) return slot.buf;
+
+    std::lock_guard<std::mutex> lock(tracer.mu);
+    tracer.buffers.emplace_back(new ThreadBuffer);
+    slot.buf = tracer.buffers.back().get();
+    slot.buf->tid = tracer.buffers.size();
+    slot.generation = gen;
+    return slot.buf;
+}
+
+void write_escaped(std::ostream& out, const string& s)
+{
+    out << '"';
+    for (const char c: s) {
+        if (c == '"' || c == '\\') out << '\\' << c;
+        else if ((unsigned char)c >= 0x20) out << c;
+    }
+    out << '"';
+}
+
+}
+
+double trace_now()
+{
+    const auto d = std::chrono::steady_clock::now() - tracer.start;
+    return std::chrono::duration<double, std::micro>(d).count();
+}
+
+void trace_record(const TraceEvent& ev)
+{
+    thread_buffer()->events.push_back(ev);
+}
+
+void trace_thread_name(const string& name)
+{
+    if (!trace_on.load(std::memory_order_relaxed)) return;
+    thread_buffer()->name = name;
+}
+
+bool trace_start(const string& fname)
+{
+    std::ofstream test(fname);
+    if (!test) return false;
+    std::lock_guard<std::mutex> lock(tracer.mu);
+    tracer.buffers.clear();
+    tracer.fname = fname;
+    tracer.generation++;
+    tracer.start = std::chrono::steady_clock::now();
+    trace_on = true;
+    return true;
+}
+
+bool trace_stop()
+{
+    if (!trace_on) return true;
+    trace_on = false;
+
+    std::lock_guard<std::mutex> lock(tracer.mu);
+    std::ofstream out(tracer.fname);
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool first = true;
+    auto sep = [&]() {
+        if (!first) out << ",\n";
+        first = false;
+    };
+    out.setf(std::ios::fixed);
+    out.precision(3);
+    for (const auto& buf: tracer.buffers) {
+        if (!buf->name.empty()) {
+            sep();
+            out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buf->tid
+            << ",\"args\":{\"name\":";
+            write_escaped(out, buf->name);
+            out << "}}";
+        }
+        for (const auto& ev: buf->events) {
+            sep();
+            out << "{\"name\":\"" << ev.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buf->tid
+            << ",\"ts\":" << ev.start << ",\"dur\":" << ev.dur;
+            if (ev.arg_name) out << ",\"args\":{\"" << ev.arg_name << "\":" << ev.arg << "}";
+            out << "}";
+        }
+    }
+    out << "\n]}\n";
+    tracer.buffers.clear();
+    tracer.generation++;
+    return (bool)out;
+}
+
+}
@@ -0,0 +1,85 @@
+/*
+ ApproxMC
+
+ Copyright (c) 2019-2020, Mate Soos and Kuldeep S. Meel. All rights reserved
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <cstdint>
+#include <limits>
+
+namespace AppMCInt {
+
+// Spans of a run, written as Chrome trace-event JSON that opens in
+// chrome://tracing or ui.perfetto.dev. While tracing is off, a span costs
+// one branch. While it is on, every thread appends to its own buffer without
+// locking, the buffers are only read by trace_stop(), once the work is done.
+
+extern std::atomic<bool> trace_on;
+
+static const int64_t no_trace_arg = std::numeric_limits<int64_t>::min();
+
+struct TraceEvent {
+    const char* name; // string literals only, they are kept until written
+    double start;     // microseconds since trace_start()
+    double dur;
+    const char* arg_name;
+    int64_t arg;
+};
+
+double trace_now();
+void trace_record(const TraceEvent& ev);
+
+class TraceSpan {
+public:
+    explicit TraceSpan(const char* _name, const char* _arg_name = nullptr,
+        const int64_t _arg = no_trace_arg)
+    {
+        if (!trace_on.load(std::memory_order_relaxed)) return;
+        ev.name = _name;
+        ev.arg_name = _arg_name;
+        ev.arg = _arg;
+        ev.start = trace_now();
+    }
+    ~TraceSpan() {
+        if (!ev.name) return;
+        ev.dur = trace_now() - ev.start;
+        trace_record(ev);
+    }
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+    TraceEvent ev = {nullptr, 0, 0, nullptr, 0};
+};
+
+// Names the calling thread in the trace
+void trace_thread_name(const std::string& name);
+
+bool trace_start(const std::string& fname);
+// Writes the trace. Other threads must not record spans any more.
+bool trace_stop();
+
+}
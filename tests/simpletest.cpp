@@ -24,9 +24,25 @@ THE SOFTWARE.
 
 #include "approxmc.h"
 #include "test_helper.h"
+#include "dimacs_mmap.h"
+#include "daemon.h"
+#include <cryptominisat5/dimacsparser.h>
+#include <cryptominisat5/streambuffer.h>
+#include <cstdio>
+#include <cstring>
+#include <csignal>
+#include <thread>
+#include <chrono>
 #include <string>
 #include <vector>
 #include <complex>
+#include <fstream>
+#include <algorithm>
+#ifndef _WIN32
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
 using std::string;
 using std::vector;
 
@@ -83,6 +99,434 @@ TEST(normal_interface, example4)
     EXPECT_EQ(std::pow(2, 9), cnt);
 }
 
+TEST(normal_interface, add_clauses)
+{
+    AppMC s;
+    s.new_vars(10);
+    const vector<Lit> lits = {Lit(0, true), Lit(1, false), Lit(2, true)};
+    const vector<uint32_t> offsets = {0, 2};
+    EXPECT_TRUE(s.add_clauses(lits.data(), lits.size(), offsets.data(), offsets.size()));
+    const vector<int32_t> dimacs = {4, 5, 0, -4, 0};
+    EXPECT_TRUE(s.add_clauses(dimacs.data(), dimacs.size()));
+    s.set_sampl_vars(vector<uint32_t>{0, 1, 2, 3, 4});
+    SolCount c = s.count();
+    EXPECT_EQ(0U, c.hashCount);
+    EXPECT_EQ(3U, c.cellSolCount);
+}
+
+TEST(normal_interface, interrupted)
+{
+    AppMC s;
+    s.new_vars(10);
+    s.interrupt_asap();
+    SolCount c = s.count();
+    EXPECT_FALSE(c.valid);
+    EXPECT_TRUE(s.get_stopped_early());
+    EXPECT_EQ(0U, s.get_rounds_done());
+}
+
+TEST(normal_interface, progress)
+{
+    AppMC s;
+    s.new_vars(10);
+    vector<CountProgress> seen;
+    s.set_progress_callback([&](const CountProgress& p) { seen.push_back(p); });
+    SolCount c = s.count();
+    ASSERT_EQ(s.get_rounds_done(), seen.size());
+    EXPECT_EQ(1U, seen.front().rounds_done);
+    EXPECT_EQ(seen.size(), seen.back().rounds);
+    EXPECT_EQ(c.hashCount, seen.back().estimate.hashCount);
+    EXPECT_EQ(c.cellSolCount, seen.back().estimate.cellSolCount);
+}
+
+TEST(normal_interface, count_stats)
+{
+    AppMC s;
+    s.new_vars(10);
+    SolCount c = s.count();
+    const CountStats& st = s.get_count_stats();
+    EXPECT_EQ(APPMC_COUNT_STATS_VERSION, st.version);
+    EXPECT_EQ(s.get_rounds_done(), st.round_hashes.size());
+    EXPECT_EQ(st.round_hashes.size(), st.round_cells.size());
+    EXPECT_EQ(c.hashCount, *std::min_element(st.round_hashes.begin(), st.round_hashes.end()));
+    EXPECT_TRUE(st.sat_calls > 0);
+    EXPECT_FALSE(st.phases.empty());
+}
+
+TEST(normal_interface, count_async_cancel)
+{
+    AppMC s;
+    s.new_vars(10);
+    uint32_t calls = 0;
+    s.set_progress_callback([&](const CountProgress&) {
+        calls++;
+        s.interrupt_asap();
+    });
+    CountHandle h = s.count_async();
+    SolCount c = h.result.get();
+    EXPECT_TRUE(c.valid);
+    EXPECT_TRUE(s.get_stopped_early());
+    EXPECT_EQ(1U, s.get_rounds_done());
+    EXPECT_EQ(1U, calls);
+}
+
+TEST(normal_interface, assumptions)
+{
+    AppMC s;
+    s.new_vars(10);
+    s.add_clause(str_to_cl("1, 2"));
+    SolCount c = s.count(str_to_cl("-1"));
+    uint32_t cnt = std::pow(2, c.hashCount)*c.cellSolCount;
+    EXPECT_EQ(std::pow(2, 8), cnt);
+
+    c = s.count(str_to_cl("1, -3"));
+    cnt = std::pow(2, c.hashCount)*c.cellSolCount;
+    EXPECT_EQ(std::pow(2, 8), cnt);
+
+    c = s.count(str_to_cl("2"));
+    cnt = std::pow(2, c.hashCount)*c.cellSolCount;
+    EXPECT_EQ(std::pow(2, 9), cnt);
+
+    // Without assumptions, on the same solver, none of the ones before are
+    // left. Exact, so that any solution they removed would show.
+    for (int i = 3; i <= 10; i++) s.add_clause(str_to_cl(std::to_string(-i)));
+    c = s.count();
+    EXPECT_EQ(0U, c.hashCount);
+    EXPECT_EQ(3U, c.cellSolCount);
+}
+
+TEST(normal_interface, sampl_sets)
+{
+    AppMC s;
+    s.new_vars(10);
+    s.add_clause(str_to_cl("1, 2"));
+    vector<CountStats> stats;
+    vector<SolCount> c = s.count_sampl_sets({{0, 1}, {2, 3, 4}, {0, 5}}, &stats);
+    ASSERT_EQ(3U, c.size());
+    EXPECT_EQ(3U, c[0].cellSolCount);
+    EXPECT_EQ(8U, c[1].cellSolCount);
+    EXPECT_EQ(4U, c[2].cellSolCount);
+    for (const auto& sc: c) EXPECT_EQ(0U, sc.hashCount);
+    ASSERT_EQ(3U, stats.size());
+    EXPECT_EQ(s.get_seed(), stats[0].seed);
+    EXPECT_NE(stats[0].seed, stats[1].seed);
+    EXPECT_NE(stats[1].seed, stats[2].seed);
+    EXPECT_FALSE(s.get_sampl_vars_set());
+}
+
+TEST(normal_interface, reset)
+{
+    AppMC s;
+    s.new_vars(10);
+    s.add_clause(str_to_cl("-1"));
+    s.set_sampl_vars(vector<uint32_t>{0, 1});
+    SolCount c = s.count();
+    EXPECT_EQ(1U, c.cellSolCount);
+
+    s.reset();
+    EXPECT_EQ(0U, s.nVars());
+    EXPECT_FALSE(s.get_sampl_vars_set());
+    s.new_vars(10);
+    c = s.count();
+    uint32_t cnt = std::pow(2, c.hashCount)*c.cellSolCount;
+    EXPECT_EQ(std::pow(2, 10), cnt);
+}
+
+TEST(normal_interface, pool)
+{
+    AppMCPool pool(1);
+    {
+        AppMCPool::Handle a = pool.acquire();
+        AppMCPool::Handle b = pool.acquire();
+        a->new_vars(3);
+        EXPECT_EQ(0U, pool.idle());
+    }
+    EXPECT_EQ(1U, pool.idle());
+    AppMCPool::Handle a = pool.acquire();
+    EXPECT_EQ(0U, a->nVars());
+    EXPECT_EQ(0U, pool.idle());
+}
+
+TEST(normal_interface, incremental)
+{
+    AppMC s;
+    s.new_vars(10);
+    s.set_incremental(true);
+    SolCount c = s.count();
+    uint32_t cnt = std::pow(2, c.hashCount)*c.cellSolCount;
+    EXPECT_EQ(std::pow(2, 10), cnt);
+
+    s.add_clause(str_to_cl("-1"));
+    s.add_xor_clause(vector<uint32_t>{1, 2}, true);
+    c = s.count();
+    cnt = std::pow(2, c.hashCount)*c.cellSolCount;
+    EXPECT_EQ(std::pow(2, 8), cnt);
+    EXPECT_TRUE(s.get_count_stats().repeated_models > 0);
+}
+
+TEST(normal_interface, checkpoint)
+{
+    const std::string fname = "appmc_test.checkpoint";
+    AppMC s;
+    s.new_vars(10);
+    s.set_checkpoint(fname, true);
+    SolCount c = s.count();
+    uint32_t cnt = std::pow(2, c.hashCount)*c.cellSolCount;
+    EXPECT_EQ(std::pow(2, 10), cnt);
+    EXPECT_FALSE(std::ifstream(fname).good());
+}
+
+// Stopped after round 1, resumed and stopped after round 3, then resumed to
+// the end. The rounds and the count are those of a count that was not stopped.
+TEST(normal_interface, checkpoint_resume)
+{
+    const std::string fname = "appmc_test_resume.checkpoint";
+    std::remove(fname.c_str());
+    AppMC full;
+    full.new_vars(10);
+    full.add_clause(str_to_cl("1, 2"));
+    const SolCount full_c = full.count();
+    const CountStats full_stats = full.get_count_stats();
+    ASSERT_TRUE(full.get_rounds_done() > 3);
+
+    uint32_t resumed_at = 0;
+    for (const uint32_t stop_at: {1U, 3U, 0U}) {
+        AppMC s;
+        s.new_vars(10);
+        s.add_clause(str_to_cl("1, 2"));
+        s.set_checkpoint(fname, true);
+        uint32_t first_round = 0;
+        s.set_progress_callback([&](const CountProgress& p) {
+            if (!first_round) first_round = p.rounds_done;
+            if (p.rounds_done == stop_at) s.interrupt_asap();
+        });
+        const SolCount c = s.count();
+        EXPECT_EQ(resumed_at+1, first_round);
+        resumed_at = stop_at;
+        if (stop_at) {
+            EXPECT_TRUE(s.get_stopped_early());
+            EXPECT_EQ(stop_at, s.get_rounds_done());
+            EXPECT_TRUE(std::ifstream(fname).good());
+            continue;
+        }
+        EXPECT_FALSE(s.get_stopped_early());
+        EXPECT_EQ(full_stats.round_hashes, s.get_count_stats().round_hashes);
+        EXPECT_EQ(full_stats.round_cells, s.get_count_stats().round_cells);
+        EXPECT_EQ(full_c.valid, c.valid);
+        EXPECT_EQ(full_c.hashCount, c.hashCount);
+        EXPECT_EQ(full_c.cellSolCount, c.cellSolCount);
+        EXPECT_FALSE(std::ifstream(fname).good());
+    }
+}
+
+TEST(dimacs_mmap, example)
+{
+    const string fname = "dimacs_mmap_example.cnf";
+    std::ofstream f(fname);
+    f << "c example\np cnf 3 2\nc ind 1 2 0\n-1\n 2 0\nx1 3 0\n";
+    f.close();
+
+    AppMC s;
+    EXPECT_TRUE(AppMCInt::read_in_file_mmap(fname, &s, 2, 0));
+    EXPECT_EQ(3U, s.nVars());
+    EXPECT_EQ(vector<uint32_t>({0, 1}), s.get_sampling_set());
+    SolCount c = s.count();
+    EXPECT_EQ(0U, c.hashCount);
+    EXPECT_EQ(3U, c.cellSolCount);
+}
+
+TEST(dimacs_mmap, left_to_stream_parser)
+{
+    const string fname = "dimacs_mmap_show.cnf";
+    std::ofstream f(fname);
+    f << "p cnf 3 1\nc p show 1 0\n1 2 0\n";
+    f.close();
+
+    AppMC s;
+    EXPECT_FALSE(AppMCInt::read_in_file_mmap(fname, &s, 2, 0));
+    EXPECT_EQ(0U, s.nVars());
+}
+
+// Keeps what a DIMACS parser hands over, to compare two parsers
+struct DimacsRecorder {
+    uint32_t nvars = 0;
+    vector<vector<Lit>> cls;
+    vector<std::pair<vector<uint32_t>, bool>> xors;
+    vector<uint32_t> sampl_vars;
+    bool sampl_vars_set = false;
+
+    uint32_t nVars() { return nvars; }
+    void new_var() { nvars++; }
+    void new_vars(uint32_t n) { nvars += n; }
+    bool add_clause(const vector<Lit>& cl) { cls.push_back(cl); return true; }
+    bool add_red_clause(const vector<Lit>&) { return true; }
+    bool add_xor_clause(const vector<uint32_t>& vars, bool rhs) {
+        xors.push_back(std::make_pair(vars, rhs));
+        return true;
+    }
+    bool add_xor_clause(const vector<Lit>& lits, bool rhs) {
+        vector<uint32_t> vars;
+        for (const Lit l: lits) {
+            vars.push_back(l.var());
+            rhs ^= l.sign();
+        }
+        return add_xor_clause(vars, rhs);
+    }
+    void set_sampl_vars(const vector<uint32_t>& vars) { sampl_vars = vars; sampl_vars_set = true; }
+    void set_opt_sampl_vars(const vector<uint32_t>&) {}
+    bool get_sampl_vars_set() const { return sampl_vars_set; }
+    void set_multiplier_weight(const mpz_class&) {}
+    void set_weighted(const bool) {}
+    void set_lit_weight(const Lit&, const double) {}
+};
+
+// Clauses of 6 literals, with 'split' each one over two lines
+static string gen_dimacs_clauses(uint32_t nvars, uint32_t ncls, bool split)
+{
+    std::stringstream b;
+    uint64_t r = 1;
+    for (uint32_t i = 0; i < ncls; i++) {
+        for (uint32_t k = 0; k < 6; k++) {
+            r = r*6364136223846793005ULL + 1442695040888963407ULL;
+            const int32_t v = (r >> 33) % nvars + 1;
+            b << (((r >> 20) & 1) ? -v : v) << ((split && k == 2) ? "\n" : " ");
+        }
+        b << "0\n";
+    }
+    return b.str();
+}
+
+static void expect_same_as_stream_parser(const string& fname, uint32_t threads, uint32_t ncls)
+{
+    DimacsRecorder mm;
+    ASSERT_TRUE(AppMCInt::read_in_file_mmap(fname, &mm, threads, 0));
+    EXPECT_EQ(ncls, mm.cls.size());
+
+    DimacsRecorder st;
+    FILE* in = fopen(fname.c_str(), "rb");
+    ASSERT_TRUE(in != nullptr);
+    DimacsParser<StreamBuffer<FILE*, FN>, DimacsRecorder> parser(&st, nullptr, 0);
+    EXPECT_TRUE(parser.parse_DIMACS(in, true));
+    fclose(in);
+
+    EXPECT_EQ(st.nvars, mm.nvars);
+    EXPECT_TRUE(st.cls == mm.cls);
+    EXPECT_TRUE(st.xors == mm.xors);
+    EXPECT_EQ(st.sampl_vars_set, mm.sampl_vars_set);
+    EXPECT_EQ(st.sampl_vars, mm.sampl_vars);
+}
+
+// Over 2MB, so it is cut into several chunks parsed on their own threads
+TEST(dimacs_mmap, parallel_chunks)
+{
+    const string fname = "dimacs_mmap_large.cnf";
+    const uint32_t ncls = 100000;
+    std::ofstream f(fname);
+    f << "p cnf 5000 " << ncls+1 << "\nc ind 1 2 3 0\n"
+    << gen_dimacs_clauses(5000, ncls, false) << "x1 -2 3 0\n";
+    f.close();
+    expect_same_as_stream_parser(fname, 4, ncls);
+}
+
+// The cut between the chunks of two threads is after the first newline from
+// the middle of the file on. The comment is padded until that newline is
+// inside a clause, which must then be parsed again in one go.
+TEST(dimacs_mmap, clause_across_chunks)
+{
+    const string fname = "dimacs_mmap_split.cnf";
+    const uint32_t ncls = 100000;
+    const string body = gen_dimacs_clauses(5000, ncls, true);
+    string data;
+    for (uint32_t pad = 0; ; pad++) {
+        data = "c " + string(pad, 'x') + "\np cnf 5000 " + std::to_string(ncls) + "\n" + body;
+        const size_t at = data.find('\n', data.size()/2);
+        ASSERT_TRUE(at != string::npos);
+        if (data[at-1] != '0' || data[at-2] != ' ') break;
+    }
+    std::ofstream f(fname);
+    f << data;
+    f.close();
+    expect_same_as_stream_parser(fname, 2, ncls);
+}
+
+#ifndef _WIN32
+// Client side of the daemon protocol, see src/daemon.h
+static bool daemon_send(int fd, const string& msg)
+{
+    const uint32_t len = msg.size();
+    const unsigned char hdr[4] = {
+        (unsigned char)(len >> 24), (unsigned char)(len >> 16),
+        (unsigned char)(len >> 8), (unsigned char)len};
+    return write(fd, hdr, 4) == 4 && write(fd, msg.data(), len) == (ssize_t)len;
+}
+
+static string daemon_recv(int fd)
+{
+    unsigned char hdr[4];
+    if (recv(fd, hdr, 4, MSG_WAITALL) != 4) return string();
+    const uint32_t len = ((uint32_t)hdr[0] << 24) | ((uint32_t)hdr[1] << 16)
+        | ((uint32_t)hdr[2] << 8) | hdr[3];
+    string msg(len, '\0');
+    if (len && recv(fd, &msg[0], len, MSG_WAITALL) != (ssize_t)len) return string();
+    return msg;
+}
+
+// Requests on one connection to a running daemon, one worker so the replies
+// come in order
+TEST(daemon, requests)
+{
+    AppMCInt::DaemonConf conf;
+    conf.socket_path = "appmc_test.sock";
+    conf.verb = 0;
+    conf.max_vars = 1000;
+    int ret = -1;
+    std::thread daemon([&]() { ret = AppMCInt::run_daemon(conf); });
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, conf.socket_path.c_str());
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    bool connected = false;
+    for (int i = 0; i < 500 && !connected; i++) {
+        connected = connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0;
+        if (!connected) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    ASSERT_TRUE(connected);
+
+    ASSERT_TRUE(daemon_send(fd, "id a\nind 1 2 0\np cnf 3 2\n1 2 0\nx1 3 0\n"));
+    string reply = daemon_recv(fd);
+    EXPECT_TRUE(reply.find("id a\n") != string::npos);
+    EXPECT_TRUE(reply.find("status ok\n") != string::npos);
+    EXPECT_TRUE(reply.find("mc 3\n") != string::npos);
+
+    ASSERT_TRUE(daemon_send(fd, "id b\np cnf 2000000000 0\n"));
+    reply = daemon_recv(fd);
+    EXPECT_TRUE(reply.find("status error\n") != string::npos);
+    EXPECT_TRUE(reply.find("too many variables") != string::npos);
+
+    ASSERT_TRUE(daemon_send(fd, "id c\nind 1 2\np cnf 3 0\n"));
+    reply = daemon_recv(fd);
+    EXPECT_TRUE(reply.find("status error\n") != string::npos);
+    EXPECT_TRUE(reply.find("not terminated") != string::npos);
+
+    ASSERT_TRUE(daemon_send(fd, "id d\nmaxtime -1\np cnf 3 0\n"));
+    reply = daemon_recv(fd);
+    EXPECT_TRUE(reply.find("invalid maxtime") != string::npos);
+
+    // Well within the limit, so not stopped early
+    ASSERT_TRUE(daemon_send(fd, "id e\nmaxtime 1000\np cnf 3 1\n1 2 0\n"));
+    reply = daemon_recv(fd);
+    EXPECT_TRUE(reply.find("mc 6\n") != string::npos);
+    EXPECT_TRUE(reply.find("stoppedearly") == string::npos);
+    close(fd);
+
+    // The daemon stops on SIGTERM, its handler is set once it listens
+    raise(SIGTERM);
+    daemon.join();
+    EXPECT_EQ(0, ret);
+}
+#endif
 
 int main(int argc, char **argv) {
   ::testing::InitGoogleTest(&argc, argv);
@@ -0,0 +1,30 @@
+#!/usr/bin/env python3
+# Reads the event logs written with 'approxmc --log FILE' (plain or .xz)
+# and prints "solve_time file" for every log that has a final estimate, the
+# same columns as solveTimes.csv. Unsolved logs go to stderr.
+
+import json
+import lzma
+import sys
+
+
+def last_estimate(fname):
+    opener = lzma.open if fname.endswith(".xz") else open
+    est = None
+    with opener(fname, "rt") as f:
+        for line in f:
+            try:
+                ev = json.loads(line)
+            except ValueError:
+                break  # cut short by a kill
+            if ev.get("ev") == "estimate":
+                est = ev
+    return est
+
+
+for fname in sys.argv[1:]:
+    est = last_estimate(fname)
+    if est and est["valid"] and not est["stopped_early"]:
+        print("%.2f %s" % (est["wall"], fname))
+    else:
+        print(fname, file=sys.stderr)
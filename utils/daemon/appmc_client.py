@@ -0,0 +1,115 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020, Mate Soos and Kuldeep S. Meel. All rights reserved
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in
+# all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+# THE SOFTWARE.
+
+"""Client for 'approxmc --daemon SOCKET'. Sends the given CNF files as count
+requests over one connection and prints the replies as they arrive."""
+
+import argparse
+import socket
+import struct
+import sys
+
+
+def send_frame(sock, text):
+    data = text.encode()
+    sock.sendall(struct.pack(">I", len(data)) + data)
+
+
+def recv_exact(sock, n):
+    buf = b""
+    while len(buf) < n:
+        chunk = sock.recv(n - len(buf))
+        if not chunk:
+            raise ConnectionError("daemon closed the connection")
+        buf += chunk
+    return buf
+
+
+def recv_frame(sock):
+    (n,) = struct.unpack(">I", recv_exact(sock, 4))
+    return recv_exact(sock, n).decode()
+
+
+def parse_reply(text):
+    reply = {}
+    for line in text.splitlines():
+        key, _, val = line.partition(" ")
+        reply[key] = val
+    return reply
+
+
+def make_request(req_id, cnf, epsilon=None, delta=None, seed=None):
+    lines = ["id %s" % req_id]
+    if epsilon is not None:
+        lines.append("epsilon %s" % epsilon)
+    if delta is not None:
+        lines.append("delta %s" % delta)
+    if seed is not None:
+        lines.append("seed %s" % seed)
+    # 'c ind' lines of the file become the sampling set of the request
+    ind = []
+    body = []
+    for line in cnf.splitlines():
+        toks = line.split()
+        if len(toks) >= 2 and toks[0] == "c" and toks[1] == "ind":
+            ind += [t for t in toks[2:] if t != "0"]
+        else:
+            body.append(line)
+    if ind:
+        lines.append("ind %s 0" % " ".join(ind))
+    return "\n".join(lines + body) + "\n"
+
+
+def connect(path):
+    sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    sock.connect(path)
+    return sock
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("socket")
+    parser.add_argument("cnf", nargs="+")
+    parser.add_argument("--epsilon")
+    parser.add_argument("--delta")
+    parser.add_argument("--seed")
+    args = parser.parse_args()
+
+    sock = connect(args.socket)
+    for i, fname in enumerate(args.cnf):
+        with open(fname) as f:
+            send_frame(sock, make_request(i, f.read(), args.epsilon, args.delta, args.seed))
+
+    failed = 0
+    for _ in args.cnf:
+        reply = parse_reply(recv_frame(sock))
+        fname = args.cnf[int(reply["id"])]
+        if reply.get("status") == "ok":
+            print("s mc %s %s" % (reply["mc"], fname))
+        else:
+            failed += 1
+            print("c %s %s: %s" % (reply.get("status"), fname, reply.get("message", "")))
+    sock.close()
+    sys.exit(1 if failed else 0)
+
+
+if __name__ == "__main__":
+    main()
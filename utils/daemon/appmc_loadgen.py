@@ -0,0 +1,87 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020, Mate Soos and Kuldeep S. Meel. All rights reserved
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in
+# all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+# THE SOFTWARE.
+
+"""Load generator for 'approxmc --daemon SOCKET'. Runs a number of clients
+in parallel, each sending requests for the given CNF files with a bounded
+number in flight, and reports throughput, latencies and refused requests."""
+
+import argparse
+import threading
+import time
+
+from appmc_client import connect, send_frame, recv_frame, parse_reply, make_request
+
+
+def client(args, cnfs, stats, lock):
+    sock = connect(args.socket)
+    sent = {}
+    next_id = 0
+    done = 0
+    while done < args.requests:
+        while next_id < args.requests and len(sent) < args.inflight:
+            cnf = cnfs[next_id % len(cnfs)]
+            send_frame(sock, make_request(next_id, cnf, seed=next_id + 1))
+            sent[next_id] = time.time()
+            next_id += 1
+        reply = parse_reply(recv_frame(sock))
+        latency = time.time() - sent.pop(int(reply["id"]))
+        done += 1
+        with lock:
+            stats.setdefault(reply.get("status", "?"), []).append(latency)
+    sock.close()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("socket")
+    parser.add_argument("cnf", nargs="+")
+    parser.add_argument("--clients", type=int, default=4)
+    parser.add_argument("--requests", type=int, default=20, help="per client")
+    parser.add_argument("--inflight", type=int, default=2, help="per client")
+    args = parser.parse_args()
+
+    cnfs = []
+    for fname in args.cnf:
+        with open(fname) as f:
+            cnfs.append(f.read())
+
+    stats = {}
+    lock = threading.Lock()
+    start = time.time()
+    threads = [threading.Thread(target=client, args=(args, cnfs, stats, lock))
+               for _ in range(args.clients)]
+    for th in threads:
+        th.start()
+    for th in threads:
+        th.join()
+    wall = time.time() - start
+
+    total = sum(len(v) for v in stats.values())
+    print("c requests: %d wall: %.2f s throughput: %.2f req/s" % (total, wall, total / wall))
+    for status, lats in sorted(stats.items()):
+        lats.sort()
+        pct = lambda p: lats[min(len(lats) - 1, int(p * len(lats)))]
+        print("c %-6s %6d  p50: %.3f s  p90: %.3f s  p99: %.3f s  max: %.3f s"
+              % (status, len(lats), pct(0.5), pct(0.9), pct(0.99), lats[-1]))
+
+
+if __name__ == "__main__":
+    main()